@@ -2,10 +2,19 @@
 
 layout(location = 0) out vec4 color;
 
-uniform vec4 u_base_color;
 uniform sampler2D tex_slot;
 in vec2 in_tex_coords;
+in vec3 in_normal;
+flat in vec4 in_base_color;
+
+// World space, towards the light.
+const vec3 light_direction = normalize(vec3(0.4, 1.0, 0.3));
 
 void main() {
-	color = texture(tex_slot, in_tex_coords) * u_base_color;
+	// Zero for primitives without normals, which stay unlit.
+	float lighting = 1.0;
+	if(dot(in_normal, in_normal) > 0.0) {
+		lighting = 0.4 + 0.6 * max(dot(normalize(in_normal), light_direction), 0.0);
+	}
+	color = texture(tex_slot, in_tex_coords) * in_base_color * vec4(vec3(lighting), 1.0);
 }
\ No newline at end of file
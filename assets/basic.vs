@@ -3,14 +3,47 @@
 layout(location = 0) in vec3 xyz;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 tex_coords;
+// Per instance, the draw's index into draws[].
+layout(location = 5) in uint draw_id;
 
 uniform mat4 u_view;
 uniform mat4 u_projection;
-uniform mat4 u_model;
+
+// gltf::Data::Draw_Data, written to the frame ring once per frame.
+struct Draw {
+	mat4 model;
+	vec4 base_color;
+	// Object to world space for normals, without the dequantization scale.
+	mat3 normal_matrix;
+	// Set for primitives from the load-time quantizer, their normal is two snorm16 values.
+	uint octahedral_normals;
+	// Set for textures whose first row is the top one, see gltf::Image::top_row_first.
+	uint top_row_first;
+	uint has_normals;
+};
+
+layout(std430, binding = 0) readonly buffer Draws {
+	Draw draws[];
+};
 
 out vec2 in_tex_coords;
+out vec3 in_normal;
+flat out vec4 in_base_color;
+
+vec3 octahedral_decode(vec2 encoded) {
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0);
+	normal.x += normal.x >= 0.0 ? -fold : fold;
+	normal.y += normal.y >= 0.0 ? -fold : fold;
+	return normalize(normal);
+}
 
 void main() {
-	gl_Position = u_projection * u_view * u_model * vec4(xyz, 1.0);
-	in_tex_coords = vec2(tex_coords.x, 1.0 - tex_coords.y);
+	Draw draw = draws[draw_id];
+	gl_Position = u_projection * u_view * draw.model * vec4(xyz, 1.0);
+	in_tex_coords = draw.top_row_first != 0u ? tex_coords : vec2(tex_coords.x, 1.0 - tex_coords.y);
+	// World space, zero without normals. The model matrix carries the dequantization scale, which must not reach normals.
+	vec3 object_normal = draw.octahedral_normals != 0u ? octahedral_decode(normal.xy) : normal;
+	in_normal = draw.has_normals != 0u ? draw.normal_matrix * object_normal : vec3(0.0);
+	in_base_color = draw.base_color;
 }
\ No newline at end of file
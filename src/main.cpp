@@ -40,12 +40,15 @@ void render() {
   float last_frame{};
 
   std::unique_ptr<gltf::Data> data = std::make_unique<gltf::Data>();
+  // basic.vs only reads POSITION, NORMAL and TEXCOORD_0.
+  data->repack.enabled = true;
+  data->repack.optimize = true;
   //data.load("assets/Sponza/glTF/Sponza.gltf");
   //data->load("assets/AnimatedCube/glTF/AnimatedCube.gltf");
   //data->load("assets/simple_animation.gltf");
   //data->load("assets/BoxAnimated/glTF/BoxAnimated.gltf");
   //data->load("assets/AnimatedMorphCube/glTF/AnimatedMorphCube.gltf");
-  data->load("assets/simple_morph.gltf");
+  data->load_async("assets/simple_morph.gltf", window.get_window_handle());
   //Animation_Player animation_player(data.operator*(), data->animations[0]);
   //Animation animation(data.operator*(), data->animations[0]);
   //data.load("assets/RiggedFigure/glTF/RiggedFigure.gltf");
@@ -99,7 +102,16 @@ void render() {
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     //animation_player.play(delta);
+    data->process_uploads();
+    data->set_view(camera.position, camera.projection);
     data->draw_all_scenes(shader.renderer_id);
+
+    if(data->is_loading()) {
+      ImGui::Begin("Loading");
+      ImGui::Text("Meshes: %d / %d", data->visible_meshes, data->total_meshes);
+      ImGui::Text("Textures: %d / %d", data->visible_textures, data->total_textures);
+      ImGui::End();
+    }
     //data2.draw_all_scenes(shader.renderer_id);
 
    /* ImGui::Begin("GLTF File");
@@ -127,6 +139,8 @@ void render() {
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
+  // Waits for a load that is still running, needs GLFW alive.
+  data.reset();
   window.destroy();
 }
 
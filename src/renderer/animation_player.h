@@ -37,6 +37,7 @@ public:
     }
 
     for(auto& channel : animation.channels) {
+      if(channel.target_node == gltf::Invalid_Node_Handle) continue;
       auto& node = animation_data.nodes[channel.target_node];
 
       if(current_time < channel.start_time || current_time > channel.end_time) continue;
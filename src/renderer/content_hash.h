@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+// 128 bit digest of a byte range, MurmurHash3 x64_128. Long enough that content from different
+// models can be matched by the digest alone, when the bytes to compare against are gone.
+struct Content_Hash {
+  uint64_t low{};
+  uint64_t high{};
+
+  auto operator<=>(const Content_Hash&) const = default;
+};
+
+namespace content_hash_detail {
+
+  constexpr uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  constexpr uint64_t mix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+  }
+
+};
+
+inline Content_Hash content_hash(std::span<const unsigned char> bytes) {
+  using namespace content_hash_detail;
+  constexpr uint64_t c1 = 0x87c37b91114253d5ull;
+  constexpr uint64_t c2 = 0x4cf5ad432745937full;
+  uint64_t h1 = 0, h2 = 0;
+
+  const size_t blocks = bytes.size() / 16;
+  for(size_t i = 0; i < blocks; ++i) {
+    uint64_t k1, k2;
+    std::memcpy(&k1, bytes.data() + i * 16, 8);
+    std::memcpy(&k2, bytes.data() + i * 16 + 8, 8);
+
+    k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  // The last 0 to 15 bytes, little-endian.
+  const unsigned char* tail = bytes.data() + blocks * 16;
+  const size_t rest = bytes.size() & 15;
+  uint64_t k1 = 0, k2 = 0;
+  for(size_t i = rest; i > 8; --i) k2 |= uint64_t(tail[i - 1]) << ((i - 9) * 8);
+  for(size_t i = std::min<size_t>(rest, 8); i > 0; --i) k1 |= uint64_t(tail[i - 1]) << ((i - 1) * 8);
+  if(rest > 8) { k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2; }
+  if(rest > 0) { k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1; }
+
+  h1 ^= uint64_t(bytes.size());
+  h2 ^= uint64_t(bytes.size());
+  h1 += h2;
+  h2 += h1;
+  h1 = mix(h1);
+  h2 = mix(h2);
+  h1 += h2;
+  h2 += h1;
+  return {h1, h2};
+}
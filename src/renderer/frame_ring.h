@@ -0,0 +1,110 @@
+#pragma once
+
+#include "gl.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// Per-frame dynamic GPU data in one persistently mapped, coherent buffer split into Frames
+// regions. The CPU fills one region while the GPU may still read the others, a fence per region
+// keeps it from writing over data a frame in flight still reads. Render thread only.
+class Frame_Ring {
+public:
+  static constexpr int Frames = 3;
+
+  // The current frame's region. data is mapped at buffer offset offset.
+  struct Region {
+    unsigned char* data{};
+    size_t offset{};
+    size_t size{};
+  };
+
+  explicit Frame_Ring(size_t region_size = 1024 * 1024) {
+    GLint alignment{};
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    region_alignment = size_t(std::max(alignment, GLint(16)));
+    create(region_size);
+  }
+
+  Frame_Ring(const Frame_Ring&) = delete;
+  Frame_Ring& operator=(const Frame_Ring&) = delete;
+
+  ~Frame_Ring() {
+    for(auto& fence : fences) wait(fence);
+    destroy();
+  }
+
+  // Starts the next frame with room for at least size bytes. Only blocks when the GPU is still
+  // reading this region from Frames frames ago, or when every region has to grow.
+  Region begin_frame(size_t size) {
+    if(size > region_size) {
+      for(auto& fence : fences) wait(fence);
+      destroy();
+      create(std::max(size, region_size * 2));
+      current = 0;
+    }
+    wait(fences[current]);
+    const size_t offset = size_t(current) * region_size;
+    return {mapped + offset, offset, region_size};
+  }
+
+  // After the last draw that reads this frame's region.
+  void end_frame() {
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current = (current + 1) % Frames;
+  }
+
+  uint32_t buffer() const {
+    return buffer_id;
+  }
+
+  // Binding offsets within a region have to be multiples of this.
+  size_t alignment() const {
+    return region_alignment;
+  }
+
+  // Frames that had to wait for the GPU, a steady count means the GPU is Frames frames behind.
+  uint64_t stalls() const {
+    return stall_count;
+  }
+
+private:
+  uint32_t buffer_id{};
+  unsigned char* mapped{};
+  size_t region_size{};
+  size_t region_alignment{};
+  int current{};
+  std::array<GLsync, Frames> fences{};
+  uint64_t stall_count{};
+
+  void create(size_t size) {
+    region_size = (size + region_alignment - 1) / region_alignment * region_alignment;
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &buffer_id);
+    glNamedBufferStorage(buffer_id, GLsizeiptr(region_size * Frames), nullptr, flags);
+    mapped = static_cast<unsigned char*>(glMapNamedBufferRange(buffer_id, 0, GLsizeiptr(region_size * Frames), flags));
+  }
+
+  void destroy() {
+    if(buffer_id == 0) return;
+    glUnmapNamedBuffer(buffer_id);
+    glDeleteBuffers(1, &buffer_id);
+    buffer_id = 0;
+    mapped = nullptr;
+  }
+
+  void wait(GLsync& fence) {
+    if(fence == nullptr) return;
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if(result == GL_TIMEOUT_EXPIRED) {
+      ++stall_count;
+      // The fence may not have reached the GPU yet, the flush bit makes sure it does.
+      do {
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+      } while(result == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+};
@@ -17,6 +17,18 @@
 #include <filesystem>
 #include <cstdint>
 
+// Core in 4.6, ARB_texture_filter_anisotropic before that, with the same values.
+#ifndef GL_TEXTURE_MAX_ANISOTROPY
+#define GL_TEXTURE_MAX_ANISOTROPY 0x84FE
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY 0x84FF
+#endif
+
+// EXT_texture_compression_s3tc, not part of any core profile but on every desktop driver.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
 // Basic structures to keep gl related data together.
 // The intention is not to create a OpenGL wrapper.
 
@@ -26,12 +38,6 @@ enum struct Buffer_Type {
   Element_Array_Buffer = GL_ELEMENT_ARRAY_BUFFER,
 };
 
-struct Buffer {
-  std::vector<unsigned char> data;
-  uint32_t renderer_id{};
-  int target{};
-};
-
 enum struct Primitive_Mode {
   Triangles      = GL_TRIANGLES,
   Triangle_Strip = GL_TRIANGLE_STRIP,
@@ -70,4 +76,6 @@ struct Vertex_Array {
 
   bool has_indices{};
   int offset{};
+  // Added to every index, or the first vertex for non-indexed draws. Lets primitives share a VAO.
+  int base_vertex{};
 };
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "common.h"
+
+#include <span>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+namespace gltf {
+
+  // How an Accessor_View element type is built from accessor components.
+  template<typename T> struct Accessor_Element;
+
+  template<> struct Accessor_Element<float> {
+    static constexpr int components = 1;
+    static float make(const float* values) { return values[0]; }
+  };
+  template<> struct Accessor_Element<glm::vec2> {
+    static constexpr int components = 2;
+    static glm::vec2 make(const float* values) { return {values[0], values[1]}; }
+  };
+  template<> struct Accessor_Element<glm::vec3> {
+    static constexpr int components = 3;
+    static glm::vec3 make(const float* values) { return {values[0], values[1], values[2]}; }
+  };
+  template<> struct Accessor_Element<glm::vec4> {
+    static constexpr int components = 4;
+    static glm::vec4 make(const float* values) { return {values[0], values[1], values[2], values[3]}; }
+  };
+  template<> struct Accessor_Element<glm::quat> {
+    static constexpr int components = 4;
+    // glTF Quat = (x, y, z, w)
+    // glm Quat constructor = (w, x, y, z)
+    static glm::quat make(const float* values) { return glm::quat(values[3], values[0], values[1], values[2]); }
+  };
+  template<> struct Accessor_Element<uint32_t> {
+    static constexpr int components = 1;
+    static constexpr bool integer = true;
+  };
+
+  template<typename T>
+  concept Integer_Element = requires { Accessor_Element<T>::integer; };
+
+  // Typed, read-only view over an accessor's elements. Nothing is copied: elements are decoded
+  // on access straight from the buffer bytes, following the bufferView stride, the accessor
+  // offset, the component type and the normalized flag.
+  template<typename T>
+  class Accessor_View {
+  public:
+    Accessor_View() = default;
+
+    Accessor_View(const Asset& asset, Accessor_Handle accessor_handle) {
+      if(accessor_handle < 0 || accessor_handle >= asset.accessors.size()) return;
+      const auto& accessor = asset.accessors[accessor_handle];
+      if(accessor.buffer_view < 0 || accessor.buffer_view >= asset.buffer_views.size()) return;
+      const auto& buffer_view = asset.buffer_views[accessor.buffer_view];
+      if(buffer_view.buffer < 0 || buffer_view.buffer >= asset.buffers.size()) return;
+
+      component_type = accessor.component_type;
+      normalized = accessor.normalized;
+      components = std::min(component_count(accessor.type), Accessor_Element<T>::components);
+      element_size = accessor.element_size();
+      byte_stride = buffer_view.byte_stride != 0 ? buffer_view.byte_stride : element_size;
+      if(element_size == 0) return;
+
+      // The last element only needs element_size bytes, not a full stride.
+      size_t required = accessor.count == 0 ? 0 : size_t(accessor.count - 1) * byte_stride + element_size;
+      auto view_bytes = asset.buffers[buffer_view.buffer].bytes;
+      if(buffer_view.byte_offset + buffer_view.byte_length > view_bytes.size()) return;
+      view_bytes = view_bytes.subspan(buffer_view.byte_offset, buffer_view.byte_length);
+      if(accessor.byte_offset + required > view_bytes.size()) return;
+
+      bytes = view_bytes.subspan(accessor.byte_offset, required);
+      count = size_t(accessor.count);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // The source bytes of one element.
+    std::span<const unsigned char> raw(size_t index) const {
+      return bytes.subspan(index * byte_stride, element_size);
+    }
+
+    // All elements as T, without any conversion. Only possible when the accessor stores
+    // exactly T, tightly packed and suitably aligned; otherwise this is empty.
+    std::span<const T> as_span() const {
+      if constexpr (Integer_Element<T>) {
+        if(component_type != GL_UNSIGNED_INT) return {};
+      } else {
+        if(component_type != GL_FLOAT) return {};
+      }
+      if(byte_stride != sizeof(T) || element_size != sizeof(T)) return {};
+      if(reinterpret_cast<uintptr_t>(bytes.data()) % alignof(T) != 0) return {};
+      return {reinterpret_cast<const T*>(bytes.data()), count};
+    }
+
+    T operator[](size_t index) const {
+      const unsigned char* element = bytes.data() + index * byte_stride;
+      if constexpr (Integer_Element<T>) {
+        return T(read_integer(element));
+      } else {
+        float values[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        const int size = component_size(component_type);
+        for(int i = 0; i < components; ++i) values[i] = read_float(element + i * size);
+        return Accessor_Element<T>::make(values);
+      }
+    }
+
+    struct Iterator {
+      const Accessor_View* view;
+      size_t index;
+
+      T operator*() const { return (*view)[index]; }
+      Iterator& operator++() { ++index; return *this; }
+      bool operator==(const Iterator& other) const { return index == other.index; }
+    };
+
+    Iterator begin() const { return {this, 0}; }
+    Iterator end() const { return {this, count}; }
+
+  private:
+    std::span<const unsigned char> bytes{};
+    size_t count{};
+    int byte_stride{};
+    int element_size{};
+    int component_type{};
+    int components{};
+    bool normalized{};
+
+    template<typename C>
+    static C load(const unsigned char* source) {
+      C value;
+      std::memcpy(&value, source, sizeof(C));
+      return value;
+    }
+
+    uint32_t read_integer(const unsigned char* source) const {
+      switch (component_type) {
+        case GL_UNSIGNED_BYTE:  return load<uint8_t>(source);
+        case GL_UNSIGNED_SHORT: return load<uint16_t>(source);
+        case GL_UNSIGNED_INT:   return load<uint32_t>(source);
+        case GL_BYTE:           return uint32_t(load<int8_t>(source));
+        case GL_SHORT:          return uint32_t(load<int16_t>(source));
+        case GL_FLOAT:          return uint32_t(load<float>(source));
+      }
+      return 0;
+    }
+
+    // Normalized integers map to [0, 1] or [-1, 1] as described in the glTF spec.
+    float read_float(const unsigned char* source) const {
+      switch (component_type) {
+        case GL_FLOAT:          return load<float>(source);
+        case GL_BYTE:           { auto c = load<int8_t>(source);   return normalized ? std::max(c / 127.0f, -1.0f) : float(c); }
+        case GL_UNSIGNED_BYTE:  { auto c = load<uint8_t>(source);  return normalized ? c / 255.0f : float(c); }
+        case GL_SHORT:          { auto c = load<int16_t>(source);  return normalized ? std::max(c / 32767.0f, -1.0f) : float(c); }
+        case GL_UNSIGNED_SHORT: { auto c = load<uint16_t>(source); return normalized ? c / 65535.0f : float(c); }
+        case GL_UNSIGNED_INT:   return float(load<uint32_t>(source));
+      }
+      return 0.0f;
+    }
+  };
+
+};
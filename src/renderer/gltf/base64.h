@@ -0,0 +1,204 @@
+#pragma once
+
+#include <string_view>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+// Compiled for the instruction set per function and picked at runtime, so the rest of the
+// build doesn't need -mavx2.
+#define GLTF_BASE64_X86 1
+#define GLTF_BASE64_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// SIMD base64 decoding after Wojciech Muła and Daniel Lemire, "Faster Base64 Encoding and Decoding
+// using AVX2 Instructions". Each vector of characters is mapped to 6 bit values with nibble lookups,
+// validated in the same pass, and the values are packed into bytes with two multiply-adds.
+
+namespace gltf {
+
+  // Exact decoded size of a padded base64 string.
+  inline size_t base64_decoded_size(std::string_view encoded) {
+    size_t size = encoded.size() / 4 * 3;
+    if(!encoded.empty() && encoded.back() == '=') --size;
+    if(encoded.size() > 1 && encoded[encoded.size() - 2] == '=') --size;
+    return size;
+  }
+
+  namespace base64_detail {
+
+    inline constexpr auto table = [] {
+      std::array<uint8_t, 256> table{};
+      table.fill(0xFF);
+      constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+      for(size_t i = 0; i < alphabet.size(); ++i) table[uint8_t(alphabet[i])] = uint8_t(i);
+      return table;
+    }();
+
+    // Decodes whole quads without padding, returns false on characters outside the alphabet.
+    inline bool decode_quads(const char* in, size_t quads, unsigned char* out) {
+      for(size_t i = 0; i < quads; ++i, in += 4, out += 3) {
+        const uint32_t a = table[uint8_t(in[0])], b = table[uint8_t(in[1])], c = table[uint8_t(in[2])], d = table[uint8_t(in[3])];
+        // Invalid characters map to 0xFF, which is the only way to get the high bit.
+        if((a | b | c | d) & 0x80) return false;
+        const uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = uint8_t(bits >> 16);
+        out[1] = uint8_t(bits >> 8);
+        out[2] = uint8_t(bits);
+      }
+      return true;
+    }
+
+    // The last quad, which may end in one or two '='.
+    inline bool decode_tail(std::string_view quad, unsigned char* out, size_t out_size) {
+      uint32_t bits = 0;
+      for(size_t j = 0; j < 4; ++j) {
+        uint8_t value = 0;
+        if(quad[j] == '=') {
+          // Padding only at the end.
+          if(j < 2 || (j == 2 && quad[3] != '=')) return false;
+        } else {
+          value = table[uint8_t(quad[j])];
+          if(value == 0xFF) return false;
+        }
+        bits = (bits << 6) | value;
+      }
+      for(size_t k = 0; k < out_size; ++k) out[k] = uint8_t(bits >> (16 - 8 * k));
+      return true;
+    }
+
+#ifdef GLTF_BASE64_X86
+    // 16 characters to 12 bytes, written as 16. Returns false on invalid characters.
+    GLTF_BASE64_TARGET("sse4.1")
+    inline bool decode_block_sse4(const char* in, unsigned char* out) {
+      const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+      const __m128i higher_nibble = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0F));
+      const __m128i lower_nibble = _mm_and_si128(input, _mm_set1_epi8(0x0F));
+
+      // Bit (higher nibble) of row (lower nibble) is set for characters in the alphabet.
+      const __m128i valid_rows = _mm_setr_epi8(
+        char(0xA8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8),
+        char(0xF8), char(0xF8), char(0xF0), char(0x54), char(0x50), char(0x50), char(0x50), char(0x54));
+      const __m128i column_bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, char(128), 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m128i valid = _mm_and_si128(_mm_shuffle_epi8(valid_rows, lower_nibble), _mm_shuffle_epi8(column_bits, higher_nibble));
+      if(_mm_movemask_epi8(_mm_cmpeq_epi8(valid, _mm_setzero_si128())) != 0) return false;
+
+      // '+' '0'-'9' 'A'-'Z' 'a'-'z' each shift by a constant picked by the higher nibble, '/' needs its own.
+      const __m128i shifts = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m128i shift = _mm_blendv_epi8(_mm_shuffle_epi8(shifts, higher_nibble), _mm_set1_epi8(16), _mm_cmpeq_epi8(input, _mm_set1_epi8('/')));
+      const __m128i values = _mm_add_epi8(input, shift);
+
+      // 00aaaaaa 00bbbbbb 00cccccc 00dddddd -> aaaaaabb bbbbcccc ccdddddd per 32 bits.
+      const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+      const __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+      const __m128i packed = _mm_shuffle_epi8(quads, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+      return true;
+    }
+
+    // 32 characters to 24 bytes, written as 32.
+    GLTF_BASE64_TARGET("avx2")
+    inline bool decode_block_avx2(const char* in, unsigned char* out) {
+      const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+      const __m256i higher_nibble = _mm256_and_si256(_mm256_srli_epi32(input, 4), _mm256_set1_epi8(0x0F));
+      const __m256i lower_nibble = _mm256_and_si256(input, _mm256_set1_epi8(0x0F));
+
+      const __m256i valid_rows = _mm256_setr_epi8(
+        char(0xA8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8),
+        char(0xF8), char(0xF8), char(0xF0), char(0x54), char(0x50), char(0x50), char(0x50), char(0x54),
+        char(0xA8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8), char(0xF8),
+        char(0xF8), char(0xF8), char(0xF0), char(0x54), char(0x50), char(0x50), char(0x50), char(0x54));
+      const __m256i column_bits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, char(128), 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 2, 4, 8, 16, 32, 64, char(128), 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m256i valid = _mm256_and_si256(_mm256_shuffle_epi8(valid_rows, lower_nibble), _mm256_shuffle_epi8(column_bits, higher_nibble));
+      if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(valid, _mm256_setzero_si256())) != 0) return false;
+
+      const __m256i shifts = _mm256_setr_epi8(
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m256i shift = _mm256_blendv_epi8(_mm256_shuffle_epi8(shifts, higher_nibble), _mm256_set1_epi8(16), _mm256_cmpeq_epi8(input, _mm256_set1_epi8('/')));
+      const __m256i values = _mm256_add_epi8(input, shift);
+
+      const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+      const __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+      const __m256i packed_lanes = _mm256_shuffle_epi8(quads, _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+      // Each 128 bit lane holds 12 bytes, move them next to each other.
+      const __m256i packed = _mm256_permutevar8x32_epi32(packed_lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+      return true;
+    }
+#endif
+
+  };
+
+  enum class Base64_Isa {
+    Scalar,
+    Sse4,
+    Avx2,
+  };
+
+  // The widest decoder this CPU can run.
+  inline Base64_Isa base64_best_isa() {
+#ifdef GLTF_BASE64_X86
+    static const Base64_Isa isa = [] {
+      __builtin_cpu_init();
+      if(__builtin_cpu_supports("avx2")) return Base64_Isa::Avx2;
+      if(__builtin_cpu_supports("sse4.1")) return Base64_Isa::Sse4;
+      return Base64_Isa::Scalar;
+    }();
+    return isa;
+#else
+    return Base64_Isa::Scalar;
+#endif
+  }
+
+  // Decodes into out, which must hold base64_decoded_size(encoded) bytes. Nothing past that is
+  // written. Returns false on characters outside the base64 alphabet.
+  inline bool base64_decode(std::string_view encoded, unsigned char* out, Base64_Isa isa = base64_best_isa()) {
+    using namespace base64_detail;
+    if(encoded.size() % 4 != 0) return false;
+    if(encoded.empty()) return true;
+
+    const size_t out_size = base64_decoded_size(encoded);
+    // The last quad is decoded on its own because of the padding.
+    const size_t body = encoded.size() - 4;
+    const char* in = encoded.data();
+    size_t read = 0;
+    size_t written = 0;
+
+#ifdef GLTF_BASE64_X86
+    // Vector blocks store a full register, so stop while that still fits in out.
+    if(isa == Base64_Isa::Avx2) {
+      while(read + 32 <= body && written + 32 <= out_size) {
+        if(!decode_block_avx2(in + read, out + written)) return false;
+        read += 32;
+        written += 24;
+      }
+    }
+    if(isa == Base64_Isa::Avx2 || isa == Base64_Isa::Sse4) {
+      while(read + 16 <= body && written + 16 <= out_size) {
+        if(!decode_block_sse4(in + read, out + written)) return false;
+        read += 16;
+        written += 12;
+      }
+    }
+#endif
+
+    if(!decode_quads(in + read, (body - read) / 4, out + written)) return false;
+    written += (body - read) / 4 * 3;
+    return decode_tail(encoded.substr(body), out + written, out_size - written);
+  }
+
+  inline bool base64_decode(std::string_view encoded, std::vector<unsigned char>& out) {
+    out.resize(base64_decoded_size(encoded));
+    return base64_decode(encoded, out.data());
+  }
+
+};
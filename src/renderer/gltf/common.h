@@ -1,6 +1,12 @@
 #pragma once
 
 #include <span>
+#include <array>
+#include <algorithm>
+#include <compare>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace gltf {
   typedef int Node_Handle;
@@ -15,19 +21,108 @@ namespace gltf {
   constexpr Node_Handle Invalid_Buffer_View_Handle = Buffer_View_Handle(-1);
   constexpr Node_Handle Invalid_Accessor_Handle = Accessor_Handle(-1);
 
+  enum class Accessor_Type {
+    Scalar, Vec2, Vec3, Vec4, Mat2, Mat3, Mat4,
+  };
+
+  constexpr int component_count(Accessor_Type type) {
+    switch (type) {
+      case Accessor_Type::Scalar: return 1;
+      case Accessor_Type::Vec2:   return 2;
+      case Accessor_Type::Vec3:   return 3;
+      case Accessor_Type::Vec4:   return 4;
+      case Accessor_Type::Mat2:   return 4;
+      case Accessor_Type::Mat3:   return 9;
+      case Accessor_Type::Mat4:   return 16;
+    }
+    return 0;
+  }
+
+  constexpr int component_size(int component_type) {
+    switch (component_type) {
+      case GL_BYTE: case GL_UNSIGNED_BYTE:   return 1;
+      case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+      case GL_INT: case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+    }
+    return 0;
+  }
+
+  // Bytes of one mip level of an image transcoded to format. The BCn formats store 4x4 blocks.
+  constexpr size_t transcoded_level_size(unsigned int format, int width, int height, int level) {
+    const size_t level_width = size_t(std::max(width >> level, 1));
+    const size_t level_height = size_t(std::max(height >> level, 1));
+    const size_t blocks = (level_width + 3) / 4 * ((level_height + 3) / 4);
+    switch (format) {
+      case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:  return blocks * 8;
+      case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return blocks * 16;
+      case GL_COMPRESSED_RGBA_BPTC_UNORM:    return blocks * 16;
+      case GL_COMPRESSED_RG_RGTC2:           return blocks * 16;
+    }
+    return level_width * level_height * 4;
+  }
+
   struct Accessor {
     Buffer_View_Handle buffer_view = Invalid_Buffer_View_Handle;
     int component_type{}; // vao type
-    int type{}; // vector type(vec3, vec4, and etc)
+    Accessor_Type type{}; // vector type(vec3, vec4, and etc)
+    bool normalized{};
     int byte_offset{}; // vao pointer
     int count{}; // number of vector types, 5 vec3s
 
-    std::vector<double> min;
-    std::vector<double> max;
+    // Only the first component_count(type) values are meaningful, and only when has_bounds is set.
+    bool has_bounds{};
+    std::array<double, 16> min{};
+    std::array<double, 16> max{};
+
+    int element_size() const {
+      return component_count(type) * component_size(component_type);
+    }
   };
 
   struct Texture2D {
     unsigned int renderer_id{};
+    int source = -1;
+    int sampler = -1;
+    // The GL sampler object for sampler, shared by every texture with the same sampler state.
+    unsigned int sampler_id{};
+    // See Image::top_row_first.
+    bool top_row_first{};
+  };
+
+  // Filters are -1 when the file leaves them to the renderer.
+  struct Sampler {
+    int mag_filter = -1;
+    int min_filter = -1;
+    int wrap_s = GL_REPEAT;
+    int wrap_t = GL_REPEAT;
+
+    auto operator<=>(const Sampler&) const = default;
+  };
+
+  struct Image {
+    std::string name{};
+    std::string uri{};
+    // The base64 text of a data: URI, pointing into the JSON. uri then only holds the "data:...;base64," prefix.
+    std::string_view embedded{};
+    std::string mime_type{};
+    Buffer_View_Handle buffer_view = Invalid_Buffer_View_Handle;
+
+    // Decoded pixels, only kept until the texture is uploaded.
+    int width{};
+    int height{};
+    int component{};
+    int bits{};
+    std::vector<unsigned char> pixels{};
+    // KTX2 and BCn encoded images: the GL internal format pixels are in, and how many mip levels
+    // follow each other in pixels, largest first. 0 for images that still need their mips built.
+    unsigned int transcoded_format{};
+    int transcoded_levels{};
+    // stb_image is set to flip decoded images so their first row is the bottom one, which basic.vs
+    // undoes. Transcoded KTX2 images can't be flipped and keep the top row first.
+    bool top_row_first{};
+    // Uploaded with only its smallest levels, see gltf::Loader::Streaming_Options. The pixels stay
+    // for the render thread to upload the rest from.
+    bool streamed{};
   };
 
   struct Material {
@@ -35,18 +130,87 @@ namespace gltf {
     int base_texture = -1;
   };
 
-#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+  // Everything a VAO captures for one primitive. Primitives with an equal layout share one VAO.
+  struct Vertex_Attribute_Layout {
+    Buffer_View_Handle buffer_view = Invalid_Buffer_View_Handle;
+    int component_type{};
+    int components{};
+    bool normalized{};
+    int byte_stride{};
+    // Relative to the primitive's base vertex.
+    int byte_offset{};
+
+    auto operator<=>(const Vertex_Attribute_Layout&) const = default;
+  };
+
+  enum Attribute {
+    Position, Normal, Texcoord_0, Joints_0, Weights_0,
+    Attribute_Count,
+  };
+
+  struct Vertex_Layout {
+    // POSITION, NORMAL, TEXCOORD_0, JOINTS_0, WEIGHTS_0
+    std::array<Vertex_Attribute_Layout, Attribute_Count> attributes{};
+    Buffer_View_Handle indices_buffer_view = Invalid_Buffer_View_Handle;
+
+    auto operator<=>(const Vertex_Layout&) const = default;
+  };
+
+  struct Upload_Stats {
+    int vertex_arrays{};
+    int buffers{};
+    size_t buffer_bytes{};
+    // bufferViews and images whose contents were already on the GPU, and the bytes they would have taken.
+    int shared_buffers{};
+    size_t shared_buffer_bytes{};
+    int textures{};
+    size_t texture_bytes{};
+    int shared_textures{};
+    size_t shared_texture_bytes{};
+  };
 
   struct SubMesh {
     Vertex_Array vao{};
     int material{};
+    // Drawn with Mesh::dequantization, normals are octahedral.
+    bool quantized{};
+    // Unlit without.
+    bool has_normals{};
+    // TEXCOORD_0 units per object space unit, averaged over the triangles. 0 when untextured or not streaming.
+    float texcoord_density{};
+  };
+
+  // A glTF primitive as it was described in the file, before it becomes a SubMesh.
+  struct Primitive {
+    std::array<Accessor_Handle, Attribute_Count> attributes = {
+      Invalid_Accessor_Handle, Invalid_Accessor_Handle, Invalid_Accessor_Handle, Invalid_Accessor_Handle, Invalid_Accessor_Handle,
+    };
+    Accessor_Handle indices = Invalid_Accessor_Handle;
+    int material = -1;
+    Primitive_Mode mode = Primitive_Mode::Triangles;
+
+    // Object space bounds of POSITION.
+    glm::vec3 min{};
+    glm::vec3 max{};
+
+    // KHR_draco_mesh_compression: the compressed mesh, and the Draco attribute id per slot.
+    Buffer_View_Handle draco_buffer_view = Invalid_Buffer_View_Handle;
+    std::array<int, Attribute_Count> draco_attributes = { -1, -1, -1, -1, -1 };
   };
 
 // Each Mesh is NOT a draw call.
 // Meshes have RenderObjects and each RenderObject IS a draw call.
   struct Mesh {
     std::string name{};
+    std::vector<Primitive> primitives{};
     std::vector<SubMesh> sub_meshes{};
+
+    // Union of the primitive bounds.
+    glm::vec3 min{};
+    glm::vec3 max{};
+
+    // Maps positions the quantizer stored as unorm16 back to the bounds.
+    glm::mat4 dequantization = glm::mat4(1.0f);
   };
 
   struct Node {
@@ -59,12 +223,53 @@ namespace gltf {
     glm::mat4 animation_transform = glm::mat4(1.0f);
   };
 
+  enum class Meshopt_Mode {
+    None,
+    Attributes,
+    Triangles,
+    Indices,
+  };
+
+  enum class Meshopt_Filter {
+    None,
+    Octahedral,
+    Quaternion,
+    Exponential,
+  };
+
+  // EXT_meshopt_compression: the bufferView's bytes are decoded from a range of another buffer.
+  struct Meshopt_Compression {
+    Meshopt_Mode mode = Meshopt_Mode::None;
+    Meshopt_Filter filter = Meshopt_Filter::None;
+    int buffer = -1;
+    size_t byte_offset{};
+    size_t byte_length{};
+    int byte_stride{};
+    int count{};
+  };
+
   struct Buffer_View {
     int buffer = -1;
-    int byte_offset{};
-    int byte_length{};
+    size_t byte_offset{};
+    size_t byte_length{};
     int byte_stride{};
     int target{};
+    Meshopt_Compression compression{};
+  };
+
+  // The bytes behind a glTF buffer. Either a view into a mapped file, or decoded from a data: URI.
+  struct Buffer_Data {
+    std::string uri{};
+    // Same as Image::embedded.
+    std::string_view embedded{};
+    size_t byte_length{};
+
+    std::span<const unsigned char> bytes{};
+    std::vector<unsigned char> owned{};
+    // Made by the vertex repack stage, not part of the file.
+    bool repacked{};
+    // Written by EXT_meshopt_compression or Draco decodes. Its own data, if any, is only a fallback.
+    bool decoded{};
   };
 
   struct Scene {
@@ -81,6 +286,8 @@ namespace gltf {
 
   enum class Interpolation {
     Linear,
+    Step,
+    Cubic_Spline,
   };
 
   struct Frame {
@@ -90,9 +297,16 @@ namespace gltf {
     glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
   };
 
+  struct Animation_Sampler {
+    Accessor_Handle input = Invalid_Accessor_Handle;
+    Accessor_Handle output = Invalid_Accessor_Handle;
+    Interpolation interpolation{};
+  };
+
   struct Animation_Channel {
     std::vector<Frame> frames;
 
+    int sampler = -1;
     Node_Handle target_node = Invalid_Node_Handle;
     Target_Path target_path{};
     Interpolation interpolation{};
@@ -105,11 +319,27 @@ namespace gltf {
     std::string name{};
     float total_animation_duration{};
     std::vector<Animation_Channel> channels;
+    std::vector<Animation_Sampler> samplers;
+  };
+
+  // Everything the glTF JSON describes. gltf::Data adds the GL objects on top.
+  struct Asset {
+    Scene_Handle default_scene = Invalid_Scene_Handle;
+    // All Scenes, Nodes, and Meshes.
+    // NOTE: Scenes can share nodes.
+    std::vector<Scene> scenes{};
+    std::vector<Node> nodes{};
+    std::vector<Mesh> meshes{};
+    std::vector<Accessor> accessors{};
+    std::vector<Material> materials{};
+    std::vector<Texture2D> textures{};
+    std::vector<Sampler> samplers{};
+    std::vector<Image> images{};
+    std::vector<Animation> animations{};
+    std::vector<Buffer_View> buffer_views{};
+    std::vector<Buffer_Data> buffers{};
+    std::vector<std::string> extensions_required{};
   };
 
 };
 
-/*
-std::span<unsigned char> get_buffer_view_slice(const Buffer& buffer, const Buffer_View& buffer_view) {
-  return std::span<unsigned char>(std::next(buffer.data.begin(), buffer_view.byte_offset), buffer_view.byte_length);
-}*/
@@ -0,0 +1,396 @@
+#pragma once
+#include "loader.h"
+
+#include <map>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// The cooked format: a glTF file after everything the loader does on the CPU, stored the way
+// gltf::Data keeps it. Vertex and index bytes are grouped per bufferView and ready to upload,
+// images are decoded or transcoded pixels, animations are flattened into keyframes. Loading one is a mapping and
+// a handful of range checks, there is nothing left to parse or decode.
+//
+// Layout: a Header at offset 0, followed by the tables and payloads it points at. Every table and
+// payload starts 16 byte aligned, all values are little-endian.
+//
+// Written by gltf_cook, read by gltf::Data::load_cooked().
+
+namespace gltf::cooked {
+
+  constexpr uint32_t Magic = 0x4B434B59; // "YKCK"
+  // Bump on any change to the structs below, old blobs are then rejected and have to be recooked.
+  constexpr uint32_t Version = 6;
+
+  // Bytes of the blob.
+  struct Range {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  // count elements of one of the structs below.
+  struct Table {
+    uint64_t offset;
+    uint64_t count;
+  };
+
+  // Into Header::strings.
+  struct String {
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    int32_t default_scene;
+
+    Table scenes;
+    Table scene_nodes;   // uint32_t
+    Table nodes;
+    Table node_children; // uint32_t
+    Table meshes;
+    Table primitives;
+    Table materials;
+    Table textures;
+    Table samplers;
+    Table images;
+    Table buffer_views;
+    Table animations;
+    Table channels;
+    Table frames;
+    Table strings;       // char
+  };
+
+  struct Scene {
+    String name;
+    uint32_t first_node;
+    uint32_t node_count;
+  };
+
+  struct Node {
+    String name;
+    int32_t mesh;
+    uint32_t first_child;
+    uint32_t child_count;
+    float translation[16];
+    float rotation[16];
+    float scale[16];
+  };
+
+  struct Mesh {
+    String name;
+    uint32_t first_primitive;
+    uint32_t primitive_count;
+    float min[3];
+    float max[3];
+    float dequantization[16];
+  };
+
+  struct Attribute {
+    int32_t buffer_view;
+    int32_t component_type;
+    int32_t components;
+    int32_t normalized;
+    int32_t byte_stride;
+    int32_t byte_offset;
+  };
+
+  // A Loader::Prepared_Primitive.
+  struct Primitive {
+    Attribute attributes[Attribute_Count];
+    int32_t indices_buffer_view;
+    int32_t mode;
+    int32_t has_indices;
+    int32_t indices_component_type;
+    int32_t count;
+    int32_t offset;
+    int32_t base_vertex;
+    int32_t material;
+    int32_t quantized;
+    float texcoord_density;
+  };
+
+  struct Material {
+    float base_color[4];
+    int32_t base_texture;
+  };
+
+  struct Texture {
+    int32_t source;
+    int32_t sampler;
+  };
+
+  struct Sampler {
+    int32_t mag_filter;
+    int32_t min_filter;
+    int32_t wrap_s;
+    int32_t wrap_t;
+  };
+
+  struct Image {
+    String name;
+    int32_t width;
+    int32_t height;
+    int32_t component;
+    int32_t bits;
+    // See gltf::Image, pixels then holds every mip level.
+    uint32_t transcoded_format;
+    int32_t transcoded_levels;
+    uint32_t top_row_first;
+    Range pixels;
+  };
+
+  // Only bufferViews that some primitive draws from have bytes.
+  struct Buffer_View {
+    Range bytes;
+  };
+
+  struct Animation {
+    String name;
+    float duration;
+    uint32_t first_channel;
+    uint32_t channel_count;
+  };
+
+  struct Channel {
+    int32_t target_node;
+    int32_t target_path;
+    int32_t interpolation;
+    float start_time;
+    float end_time;
+    uint32_t first_frame;
+    uint32_t frame_count;
+  };
+
+  struct Frame {
+    float time;
+    float translation[3];
+    float rotation[4]; // x, y, z, w
+    float scale[3];
+  };
+
+  constexpr size_t Alignment = 16;
+
+  template<typename T>
+  bool table_fits(std::span<const unsigned char> blob, const Table& entry) {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= Alignment);
+    return entry.count == 0 || (entry.offset % Alignment == 0 && entry.offset <= blob.size() && entry.count <= (blob.size() - entry.offset) / sizeof(T));
+  }
+
+  // Only after table_fits() said yes.
+  template<typename T>
+  std::span<const T> table(std::span<const unsigned char> blob, const Table& entry) {
+    if(entry.count == 0) return {};
+    return {reinterpret_cast<const T*>(blob.data() + entry.offset), size_t(entry.count)};
+  }
+
+  inline bool range_fits(std::span<const unsigned char> blob, const Range& range) {
+    return range.offset <= blob.size() && range.size <= blob.size() - range.offset;
+  }
+
+  class Writer {
+  public:
+    // Everything load_sources() produced. Fails when a required bufferView or image is missing.
+    static bool cook(const Loader& asset, std::vector<unsigned char>& blob) {
+      Writer writer;
+      return writer.write(asset, blob);
+    }
+
+  private:
+    std::vector<unsigned char> payload;
+    std::vector<char> strings;
+    std::multimap<std::pair<uint64_t, size_t>, Range> payload_ranges;
+    size_t shared_bytes{};
+
+    String add_string(const std::string& text) {
+      String string{uint32_t(strings.size()), uint32_t(text.size())};
+      strings.insert(strings.end(), text.begin(), text.end());
+      return string;
+    }
+
+    // Payload offsets are relative to the payload until write() knows where it starts. Equal bytes
+    // are stored once and share a range.
+    Range add_bytes(std::span<const unsigned char> bytes) {
+      const std::string_view view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+      const auto key = std::pair(std::hash<std::string_view>{}(view), bytes.size());
+      for(auto [it, last] = payload_ranges.equal_range(key); it != last; ++it) {
+        if(bytes.empty() || std::memcmp(payload.data() + it->second.offset, bytes.data(), bytes.size()) == 0) {
+          shared_bytes += bytes.size();
+          return it->second;
+        }
+      }
+
+      payload.resize((payload.size() + Alignment - 1) & ~(Alignment - 1));
+      Range range{payload.size(), bytes.size()};
+      payload.insert(payload.end(), bytes.begin(), bytes.end());
+      payload_ranges.emplace(key, range);
+      return range;
+    }
+
+    static void copy_matrix(float* destination, const glm::mat4& matrix) {
+      std::memcpy(destination, &matrix[0][0], sizeof(float) * 16);
+    }
+
+    template<typename T>
+    static void append(std::vector<unsigned char>& blob, Table& table, std::span<const T> elements) {
+      blob.resize((blob.size() + Alignment - 1) & ~(Alignment - 1));
+      table = {blob.size(), elements.size()};
+      auto* first = reinterpret_cast<const unsigned char*>(elements.data());
+      blob.insert(blob.end(), first, first + elements.size_bytes());
+    }
+
+    bool write(const Loader& asset, std::vector<unsigned char>& blob) {
+      std::vector<Scene> scenes;
+      std::vector<uint32_t> scene_nodes;
+      for(const auto& scene : asset.scenes) {
+        scenes.push_back({add_string(scene.name), uint32_t(scene_nodes.size()), uint32_t(scene.nodes.size())});
+        for(auto node : scene.nodes) scene_nodes.push_back(uint32_t(node));
+      }
+
+      std::vector<Node> nodes;
+      std::vector<uint32_t> node_children;
+      for(const auto& node : asset.nodes) {
+        Node& cooked = nodes.emplace_back();
+        cooked.name = add_string(node.name);
+        cooked.mesh = node.mesh;
+        cooked.first_child = uint32_t(node_children.size());
+        cooked.child_count = uint32_t(node.children.size());
+        copy_matrix(cooked.translation, node.translation);
+        copy_matrix(cooked.rotation, node.rotation);
+        copy_matrix(cooked.scale, node.scale);
+        for(auto child : node.children) node_children.push_back(uint32_t(child));
+      }
+
+      std::vector<Mesh> meshes;
+      std::vector<Primitive> primitives;
+      std::vector<bool> used_buffer_views(asset.buffer_views.size(), false);
+      for(int mesh_index = 0; mesh_index < asset.meshes.size(); ++mesh_index) {
+        const auto& mesh = asset.meshes[mesh_index];
+        const auto& prepared = asset.prepared_meshes[mesh_index];
+        Mesh& cooked_mesh = meshes.emplace_back();
+        cooked_mesh = {add_string(mesh.name), uint32_t(primitives.size()), uint32_t(prepared.size()),
+                       {mesh.min.x, mesh.min.y, mesh.min.z}, {mesh.max.x, mesh.max.y, mesh.max.z}, {}};
+        copy_matrix(cooked_mesh.dequantization, mesh.dequantization);
+
+        for(const auto& [layout, vao, material, quantized, texcoord_density] : prepared) {
+          Primitive& cooked = primitives.emplace_back();
+          for(int slot = 0; slot < Attribute_Count; ++slot) {
+            const auto& attribute = layout.attributes[slot];
+            cooked.attributes[slot] = {attribute.buffer_view, attribute.component_type, attribute.components,
+                                       attribute.normalized, attribute.byte_stride, attribute.byte_offset};
+            if(attribute.buffer_view != Invalid_Buffer_View_Handle) used_buffer_views[attribute.buffer_view] = true;
+          }
+          cooked.indices_buffer_view = layout.indices_buffer_view;
+          if(layout.indices_buffer_view != Invalid_Buffer_View_Handle) used_buffer_views[layout.indices_buffer_view] = true;
+          cooked.mode = int32_t(vao.primitive_mode);
+          cooked.has_indices = vao.has_indices;
+          cooked.indices_component_type = int32_t(vao.indices_component_type);
+          cooked.count = vao.count;
+          cooked.offset = vao.offset;
+          cooked.base_vertex = vao.base_vertex;
+          cooked.material = material;
+          cooked.quantized = quantized;
+          cooked.texcoord_density = texcoord_density;
+        }
+      }
+
+      std::vector<Buffer_View> buffer_views(asset.buffer_views.size(), Buffer_View{});
+      for(int buffer_view_index = 0; buffer_view_index < asset.buffer_views.size(); ++buffer_view_index) {
+        if(!used_buffer_views[buffer_view_index]) continue;
+        auto bytes = asset.buffer_view_data(buffer_view_index);
+        if(bytes.size() != asset.buffer_views[buffer_view_index].byte_length) {
+          std::cout << "BufferView " << buffer_view_index << " has no data." << std::endl;
+          return false;
+        }
+        buffer_views[buffer_view_index].bytes = add_bytes(bytes);
+      }
+
+      std::vector<Material> materials;
+      for(const auto& material : asset.materials) {
+        materials.push_back({{material.base_color.x, material.base_color.y, material.base_color.z, material.base_color.w}, material.base_texture});
+      }
+
+      std::vector<Texture> textures;
+      for(const auto& texture : asset.textures) textures.push_back({texture.source, texture.sampler});
+
+      std::vector<Sampler> samplers;
+      for(const auto& sampler : asset.samplers) samplers.push_back({sampler.mag_filter, sampler.min_filter, sampler.wrap_s, sampler.wrap_t});
+
+      std::vector<Image> images;
+      for(int image_index = 0; image_index < asset.images.size(); ++image_index) {
+        // A duplicate is stored as the image decoded in its place, add_bytes() keeps one copy.
+        const auto& image = asset.images[asset.image_source(image_index)];
+        const String name = add_string(asset.images[image_index].name);
+        if(!asset.image_used(image_index)) {
+          images.push_back({name, 0, 0, 0, 8, 0, 0, 0, Range{}});
+          continue;
+        }
+        if(image.pixels.empty()) {
+          std::cout << "Image " << image_index << " has no pixels." << std::endl;
+          return false;
+        }
+        images.push_back({name, image.width, image.height, image.component, image.bits, image.transcoded_format, image.transcoded_levels, image.top_row_first,
+                          add_bytes(image.pixels)});
+      }
+
+      std::vector<Animation> animations;
+      std::vector<Channel> channels;
+      std::vector<Frame> frames;
+      for(const auto& animation : asset.animations) {
+        animations.push_back({add_string(animation.name), animation.total_animation_duration, uint32_t(channels.size()), uint32_t(animation.channels.size())});
+        for(const auto& channel : animation.channels) {
+          channels.push_back({channel.target_node, int32_t(channel.target_path), int32_t(channel.interpolation),
+                              channel.start_time, channel.end_time, uint32_t(frames.size()), uint32_t(channel.frames.size())});
+          for(const auto& frame : channel.frames) {
+            frames.push_back({frame.time,
+                              {frame.translation.x, frame.translation.y, frame.translation.z},
+                              {frame.rotation.x, frame.rotation.y, frame.rotation.z, frame.rotation.w},
+                              {frame.scale.x, frame.scale.y, frame.scale.z}});
+          }
+        }
+      }
+
+      Header header{};
+      header.magic = Magic;
+      header.version = Version;
+      header.header_size = sizeof(Header);
+      header.default_scene = asset.default_scene;
+
+      blob.assign(sizeof(Header), 0);
+      append<Scene>(blob, header.scenes, scenes);
+      append<uint32_t>(blob, header.scene_nodes, scene_nodes);
+      append<Node>(blob, header.nodes, nodes);
+      append<uint32_t>(blob, header.node_children, node_children);
+      append<Mesh>(blob, header.meshes, meshes);
+      append<Primitive>(blob, header.primitives, primitives);
+      append<Material>(blob, header.materials, materials);
+      append<Texture>(blob, header.textures, textures);
+      append<Sampler>(blob, header.samplers, samplers);
+      append<Animation>(blob, header.animations, animations);
+      append<Channel>(blob, header.channels, channels);
+      append<Frame>(blob, header.frames, frames);
+      append<char>(blob, header.strings, strings);
+
+      // The payload goes last, so the offsets taken while collecting it only need shifting.
+      blob.resize((blob.size() + Alignment - 1) & ~(Alignment - 1));
+      const uint64_t payload_offset = blob.size();
+      blob.insert(blob.end(), payload.begin(), payload.end());
+      for(auto& image : images) image.pixels.offset += payload_offset;
+      for(auto& buffer_view : buffer_views) {
+        if(buffer_view.bytes.size != 0) buffer_view.bytes.offset += payload_offset;
+      }
+      append<Image>(blob, header.images, images);
+      append<Buffer_View>(blob, header.buffer_views, buffer_views);
+
+      std::memcpy(blob.data(), &header, sizeof(Header));
+      if(shared_bytes > 0) std::cout << "Cooked payload: " << shared_bytes << " bytes of repeated bufferViews and images stored once" << std::endl;
+      return true;
+    }
+  };
+
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../gl.h"
+
+#include <draco/compression/decode.h>
+
+#include <span>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+// KHR_draco_mesh_compression through Google's Draco decoder. The loader points a primitive's
+// accessors at a buffer of its own and this writes the decoded mesh there, in the formats the
+// accessors declare, so nothing after decoding knows the data was compressed.
+
+namespace gltf {
+
+  // Where the indices or one attribute go. Elements are stride bytes apart.
+  struct Draco_Output {
+    // The Draco attribute id from the extension, -1 for the indices.
+    int unique_id = -1;
+    unsigned char* destination = nullptr;
+    int component_type{};
+    int components{};
+    size_t count{};
+    size_t stride{};
+  };
+
+  namespace draco_detail {
+
+    template<typename T>
+    bool write_attribute(const draco::PointAttribute& attribute, const Draco_Output& output) {
+      T value[16];
+      for(uint32_t point = 0; point < output.count; ++point) {
+        if(!attribute.ConvertValue<T>(attribute.mapped_index(draco::PointIndex(point)), int8_t(output.components), value)) return false;
+        std::memcpy(output.destination + point * output.stride, value, sizeof(T) * output.components);
+      }
+      return true;
+    }
+
+    inline bool write_index(const Draco_Output& output, size_t i, uint32_t index) {
+      unsigned char* to = output.destination + i * output.stride;
+      switch (output.component_type) {
+        case GL_UNSIGNED_BYTE:  { const uint8_t narrow = uint8_t(index);   std::memcpy(to, &narrow, 1); return true; }
+        case GL_UNSIGNED_SHORT: { const uint16_t narrow = uint16_t(index); std::memcpy(to, &narrow, 2); return true; }
+        case GL_UNSIGNED_INT:   { std::memcpy(to, &index, 4); return true; }
+      }
+      return false;
+    }
+
+  };
+
+  // Outputs with no destination are skipped. On failure error says why.
+  inline bool draco_decode_mesh(std::span<const unsigned char> encoded, std::span<const Draco_Output> attributes, const Draco_Output& indices, std::string& error) {
+    draco::DecoderBuffer buffer;
+    buffer.Init(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    draco::Decoder decoder;
+    auto decoded = decoder.DecodeMeshFromBuffer(&buffer);
+    if(!decoded.ok()) {
+      error = decoded.status().error_msg_string();
+      return false;
+    }
+    const std::unique_ptr<draco::Mesh> mesh = std::move(decoded).value();
+
+    if(indices.destination != nullptr) {
+      if(indices.count != size_t(mesh->num_faces()) * 3) {
+        error = "the indices accessor doesn't match the face count";
+        return false;
+      }
+      for(uint32_t face = 0; face < mesh->num_faces(); ++face) {
+        const auto& corners = mesh->face(draco::FaceIndex(face));
+        for(int corner = 0; corner < 3; ++corner) {
+          if(!draco_detail::write_index(indices, size_t(face) * 3 + corner, corners[corner].value())) {
+            error = "unsupported index component type";
+            return false;
+          }
+        }
+      }
+    }
+
+    for(const auto& output : attributes) {
+      if(output.destination == nullptr) continue;
+      const draco::PointAttribute* attribute = mesh->GetAttributeByUniqueId(uint32_t(output.unique_id));
+      if(attribute == nullptr) {
+        error = "no attribute with id " + std::to_string(output.unique_id);
+        return false;
+      }
+      if(output.count != mesh->num_points()) {
+        error = "an attribute accessor doesn't match the point count";
+        return false;
+      }
+
+      bool ok = false;
+      switch (output.component_type) {
+        case GL_FLOAT:          { ok = draco_detail::write_attribute<float>(*attribute, output);    break; }
+        case GL_UNSIGNED_INT:   { ok = draco_detail::write_attribute<uint32_t>(*attribute, output); break; }
+        case GL_UNSIGNED_SHORT: { ok = draco_detail::write_attribute<uint16_t>(*attribute, output); break; }
+        case GL_SHORT:          { ok = draco_detail::write_attribute<int16_t>(*attribute, output);  break; }
+        case GL_UNSIGNED_BYTE:  { ok = draco_detail::write_attribute<uint8_t>(*attribute, output);  break; }
+        case GL_BYTE:           { ok = draco_detail::write_attribute<int8_t>(*attribute, output);   break; }
+      }
+      if(!ok) {
+        error = "attribute " + std::to_string(output.unique_id) + " can't be converted to its accessor format";
+        return false;
+      }
+    }
+    return true;
+  }
+
+};
@@ -0,0 +1,357 @@
+#pragma once
+#include "mapped_file.h"
+#include "../../thread_pool.h"
+
+#include <span>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <cstring>
+#include <functional>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <atomic>
+#define GLTF_IO_URING 1
+#endif
+
+// How the loader gets at external .bin and image files. All reads of a load are handed over in
+// one call, so a backend can keep every one of them in flight at once instead of paying the
+// per-file latency of network or cold storage one file after the other.
+
+namespace gltf {
+
+  struct File_Contents {
+    bool ok = false;
+    std::span<const unsigned char> bytes{};
+
+    // Whichever of the two holds the bytes.
+    std::vector<unsigned char> owned{};
+    std::unique_ptr<Mapped_File> mapping{};
+  };
+
+  struct File_Read {
+    std::string path{};
+    // Called exactly once per read, from any thread, possibly before the File_System returns.
+    std::function<void(File_Contents)> on_complete{};
+  };
+
+  using File_System = std::function<void(std::vector<File_Read>)>;
+
+  inline File_Contents read_whole_file(const std::string& path) {
+    File_Contents contents;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if(!file) return contents;
+
+    auto size = file.tellg();
+    file.seekg(0);
+    contents.owned.resize(size_t(size));
+    if(!file.read(reinterpret_cast<char*>(contents.owned.data()), size)) return contents;
+
+    contents.bytes = contents.owned;
+    contents.ok = true;
+    return contents;
+  }
+
+  // Blocking reads, one per pool job.
+  inline void read_files(std::vector<File_Read> reads) {
+    for(auto& read : reads) {
+      Thread_Pool::shared().submit([read = std::move(read)] { read.on_complete(read_whole_file(read.path)); });
+    }
+  }
+
+  // Maps instead of reading. Nothing is copied, but the pages are only read when first touched,
+  // so this is best for files that are already in the page cache.
+  inline void map_files(std::vector<File_Read> reads) {
+    for(auto& read : reads) {
+      Thread_Pool::shared().submit([read = std::move(read)] {
+        File_Contents contents;
+        contents.mapping = std::make_unique<Mapped_File>();
+        contents.ok = contents.mapping->open(read.path);
+        contents.bytes = contents.mapping->bytes();
+        read.on_complete(std::move(contents));
+      });
+    }
+  }
+
+#if GLTF_IO_URING
+  // Just enough of io_uring to keep many operations in flight, without depending on liburing.
+  class Io_Uring {
+  public:
+    Io_Uring() = default;
+    Io_Uring(const Io_Uring&) = delete;
+    Io_Uring& operator=(const Io_Uring&) = delete;
+
+    bool init(unsigned entries) {
+      io_uring_params params{};
+      ring_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+      // Not available, or blocked by a seccomp profile as in many containers.
+      if(ring_fd < 0) return false;
+
+      sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if(single_mmap) sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+      sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+      if(sq_ring == MAP_FAILED) { sq_ring = nullptr; return false; }
+      cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+      if(cq_ring == MAP_FAILED) { cq_ring = nullptr; return false; }
+      sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+      void* sqes_mapping = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+      if(sqes_mapping == MAP_FAILED) return false;
+      sqes = static_cast<io_uring_sqe*>(sqes_mapping);
+
+      auto* sq = static_cast<unsigned char*>(sq_ring);
+      auto* cq = static_cast<unsigned char*>(cq_ring);
+      sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+      sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+      entries_count = params.sq_entries;
+      return true;
+    }
+
+    ~Io_Uring() {
+      if(sqes) munmap(sqes, sqes_size);
+      if(cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+      if(sq_ring) munmap(sq_ring, sq_ring_size);
+      if(ring_fd >= 0) ::close(ring_fd);
+    }
+
+    unsigned capacity() const {
+      return entries_count;
+    }
+
+    // Queues one operation, false when the submission ring is full.
+    bool push(const io_uring_sqe& entry) {
+      unsigned head = std::atomic_ref(*sq_head).load(std::memory_order_acquire);
+      unsigned tail = *sq_tail;
+      if(tail - head >= entries_count) return false;
+
+      unsigned index = tail & sq_mask;
+      sqes[index] = entry;
+      sq_array[index] = index;
+      std::atomic_ref(*sq_tail).store(tail + 1, std::memory_order_release);
+      ++unsubmitted;
+      return true;
+    }
+
+    // Submits what was pushed and sleeps until at least one operation completed.
+    bool submit_and_wait() {
+      int submitted = int(syscall(__NR_io_uring_enter, ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+      if(submitted < 0) return errno == EINTR;
+      unsubmitted -= unsigned(submitted);
+      return true;
+    }
+
+    template<typename F>
+    void drain(F&& on_completion) {
+      unsigned head = *cq_head;
+      unsigned tail = std::atomic_ref(*cq_tail).load(std::memory_order_acquire);
+      for(; head != tail; ++head) {
+        const auto& completion = cqes[head & cq_mask];
+        on_completion(completion.user_data, completion.res);
+      }
+      std::atomic_ref(*cq_head).store(head, std::memory_order_release);
+    }
+
+  private:
+    int ring_fd = -1;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    size_t sq_ring_size{};
+    size_t cq_ring_size{};
+    size_t sqes_size{};
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask{};
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask{};
+    io_uring_cqe* cqes = nullptr;
+    unsigned entries_count{};
+    unsigned unsubmitted{};
+  };
+
+  // Opens, sizes and reads every file through one ring. Runs on its own thread so completions
+  // are delivered while the loader keeps going.
+  class Io_Uring_Reader {
+  public:
+    static constexpr unsigned Ring_Entries = 256;
+    // Reads are split so one huge file can't hold a single operation for seconds.
+    static constexpr size_t Max_Read = 64 * 1024 * 1024;
+
+    Io_Uring_Reader(std::unique_ptr<Io_Uring> ring, std::vector<File_Read> reads)
+      : ring(std::move(ring)), reads(std::move(reads)), files(this->reads.size()) {}
+
+    void run() {
+      for(uint64_t i = 0; i < reads.size(); ++i) {
+        io_uring_sqe open{};
+        open.opcode = IORING_OP_OPENAT;
+        open.fd = AT_FDCWD;
+        open.addr = uint64_t(reinterpret_cast<uintptr_t>(reads[i].path.c_str()));
+        open.open_flags = O_RDONLY | O_CLOEXEC;
+        open.user_data = (i << 2) | Open;
+        queued.push_back(open);
+
+        // Sized by path at the same time, saving a round trip per file.
+        io_uring_sqe stat{};
+        stat.opcode = IORING_OP_STATX;
+        stat.fd = AT_FDCWD;
+        stat.addr = uint64_t(reinterpret_cast<uintptr_t>(reads[i].path.c_str()));
+        stat.len = STATX_SIZE;
+        stat.off = uint64_t(reinterpret_cast<uintptr_t>(&files[i].stat));
+        stat.user_data = (i << 2) | Stat;
+        queued.push_back(stat);
+
+        files[i].waiting = 2;
+      }
+
+      size_t remaining = reads.size();
+      while(remaining > 0) {
+        while(!queued.empty() && in_flight < ring->capacity() && ring->push(queued.front())) {
+          queued.pop_front();
+          ++in_flight;
+        }
+
+        if(!ring->submit_and_wait()) {
+          // The ring is broken. Operations still in flight may write into files, so leak them
+          // rather than free memory the kernel might still touch, and let the pool finish the job.
+          for(size_t i = 0; i < files.size(); ++i) {
+            if(!files[i].finished) read_files({std::move(reads[i])});
+          }
+          new std::vector<Pending_File>(std::move(files));
+          return;
+        }
+
+        ring->drain([&](uint64_t user_data, int result) {
+          --in_flight;
+          size_t index = size_t(user_data >> 2);
+          if(on_completion(index, Operation(user_data & 3), result)) --remaining;
+        });
+      }
+    }
+
+  private:
+    enum Operation : uint64_t { Open, Stat, Read };
+
+    struct Pending_File {
+      int fd = -1;
+      int waiting{};
+      bool failed{};
+      bool unsupported{};
+      bool finished{};
+      struct statx stat{};
+      size_t done{};
+      File_Contents contents{};
+    };
+
+    std::unique_ptr<Io_Uring> ring;
+    std::vector<File_Read> reads;
+    std::vector<Pending_File> files;
+    std::deque<io_uring_sqe> queued;
+    unsigned in_flight{};
+
+    void queue_read(size_t index) {
+      auto& file = files[index];
+      io_uring_sqe read{};
+      read.opcode = IORING_OP_READ;
+      read.fd = file.fd;
+      read.addr = uint64_t(reinterpret_cast<uintptr_t>(file.contents.owned.data() + file.done));
+      read.len = unsigned(std::min(Max_Read, file.contents.owned.size() - file.done));
+      read.off = file.done;
+      read.user_data = (uint64_t(index) << 2) | Read;
+      queued.push_back(read);
+    }
+
+    // True once the file is done with, one way or another.
+    bool on_completion(size_t index, Operation operation, int result) {
+      auto& file = files[index];
+
+      if(operation == Open || operation == Stat) {
+        // Kernels before 5.6 don't know these opcodes.
+        if(result == -EINVAL) file.unsupported = true;
+        if(result < 0) file.failed = true;
+        else if(operation == Open) file.fd = result;
+        if(--file.waiting > 0) return false;
+
+        if(file.failed) return finish(index);
+        file.contents.owned.resize(size_t(file.stat.stx_size));
+        if(file.contents.owned.empty()) return finish(index);
+        queue_read(index);
+        return false;
+      }
+
+      if(result == -EINTR || result == -EAGAIN) {
+        queue_read(index);
+        return false;
+      }
+      if(result == -EINVAL) file.unsupported = true;
+      if(result < 0) {
+        file.failed = true;
+        return finish(index);
+      }
+
+      file.done += size_t(result);
+      // A file that shrank since it was sized.
+      if(result == 0) file.contents.owned.resize(file.done);
+      if(file.done < file.contents.owned.size()) {
+        queue_read(index);
+        return false;
+      }
+      return finish(index);
+    }
+
+    bool finish(size_t index) {
+      auto& file = files[index];
+      file.finished = true;
+      if(file.fd >= 0) ::close(file.fd);
+
+      if(file.unsupported) {
+        read_files({std::move(reads[index])});
+        return true;
+      }
+
+      file.contents.ok = !file.failed;
+      file.contents.bytes = file.contents.owned;
+      reads[index].on_complete(std::move(file.contents));
+      return true;
+    }
+  };
+
+  // Every read goes into one io_uring at once. Falls back to read_files() when io_uring is not available.
+  inline void read_files_io_uring(std::vector<File_Read> reads) {
+    if(reads.empty()) return;
+
+    auto ring = std::make_unique<Io_Uring>();
+    if(!ring->init(Io_Uring_Reader::Ring_Entries)) {
+      read_files(std::move(reads));
+      return;
+    }
+
+    std::thread([reader = std::make_shared<Io_Uring_Reader>(std::move(ring), std::move(reads))] { reader->run(); }).detach();
+  }
+#endif
+
+  inline File_System default_file_system() {
+#if GLTF_IO_URING
+    return read_files_io_uring;
+#else
+    return read_files;
+#endif
+  }
+
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Load-time triangle list optimization, run by the repack stage when Repack_Options::optimize is
+// set. Every pass works on a vertex stream and the indices of the triangle lists drawing from it:
+//
+//   weld_vertices          merges vertices whose bytes are identical
+//   optimize_vertex_cache  reorders triangles for the post-transform cache (Forsyth)
+//   optimize_overdraw      reorders cache-friendly clusters front to back (Sander et al.)
+//   optimize_vertex_fetch  renumbers vertices in the order they are first used
+//
+// analyze_vertex_cache() measures the result on a simulated FIFO cache.
+
+namespace gltf {
+
+  struct Vertex_Cache_Stats {
+    size_t misses{};
+    size_t triangles{};
+    size_t vertices{};
+
+    // Average cache miss ratio: transformed vertices per triangle, 0.5 is the ideal for large grids.
+    double acmr() const { return triangles == 0 ? 0.0 : double(misses) / triangles; }
+    // Average transform to vertex ratio: 1.0 means every vertex is transformed exactly once.
+    double atvr() const { return vertices == 0 ? 0.0 : double(misses) / vertices; }
+  };
+
+  // A FIFO cache like the post-transform caches of most GPUs.
+  inline Vertex_Cache_Stats analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertex_count, size_t cache_size = 16) {
+    Vertex_Cache_Stats stats;
+    stats.triangles = indices.size() / 3;
+    stats.vertices = vertex_count;
+
+    // A vertex is cached while fewer than cache_size misses happened since it was loaded.
+    std::vector<size_t> loaded_at(vertex_count, 0);
+    size_t time = cache_size + 1;
+    for(uint32_t index : indices) {
+      if(time - loaded_at[index] > cache_size) {
+        loaded_at[index] = time++;
+        ++stats.misses;
+      }
+    }
+    return stats;
+  }
+
+  // Maps every vertex to the first one with the same bytes. Returns how many distinct ones there are,
+  // remap then numbers them in order of first appearance.
+  inline size_t weld_vertices(std::span<const unsigned char> vertices, size_t stride, std::vector<uint32_t>& remap) {
+    const size_t vertex_count = vertices.size() / stride;
+    remap.resize(vertex_count);
+
+    std::unordered_map<std::string_view, uint32_t> first_of;
+    first_of.reserve(vertex_count);
+    for(size_t vertex = 0; vertex < vertex_count; ++vertex) {
+      const std::string_view bytes(reinterpret_cast<const char*>(vertices.data() + vertex * stride), stride);
+      remap[vertex] = first_of.try_emplace(bytes, uint32_t(first_of.size())).first->second;
+    }
+    return first_of.size();
+  }
+
+  // Tom Forsyth, "Linear-Speed Vertex Cache Optimisation". Greedily emits the triangle whose
+  // vertices score highest: recently used ones, and ones with few triangles left to draw.
+  inline void optimize_vertex_cache(std::span<uint32_t> indices, size_t vertex_count) {
+    constexpr int Cache_Size = 32;
+    const size_t triangle_count = indices.size() / 3;
+    if(triangle_count == 0) return;
+
+    auto vertex_score = [](int cache_position, uint32_t remaining) {
+      if(remaining == 0) return -1.0f;
+      float score = 0.0f;
+      if(cache_position >= 0) {
+        // The triangle just drawn gets a fixed score so its neighbours don't win by default.
+        score = cache_position < 3 ? 0.75f : std::pow(1.0f - float(cache_position - 3) / (Cache_Size - 3), 1.5f);
+      }
+      return score + 2.0f / std::sqrt(float(remaining));
+    };
+
+    // Triangles of each vertex, as offsets into one array.
+    std::vector<uint32_t> first_triangle(vertex_count + 1, 0);
+    for(uint32_t index : indices) ++first_triangle[index + 1];
+    std::partial_sum(first_triangle.begin(), first_triangle.end(), first_triangle.begin());
+    std::vector<uint32_t> vertex_triangles(indices.size());
+    {
+      std::vector<uint32_t> filled(first_triangle.begin(), first_triangle.end() - 1);
+      for(size_t i = 0; i < indices.size(); ++i) vertex_triangles[filled[indices[i]]++] = uint32_t(i / 3);
+    }
+
+    std::vector<uint32_t> remaining(vertex_count);
+    for(size_t vertex = 0; vertex < vertex_count; ++vertex) remaining[vertex] = first_triangle[vertex + 1] - first_triangle[vertex];
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for(size_t vertex = 0; vertex < vertex_count; ++vertex) score[vertex] = vertex_score(-1, remaining[vertex]);
+
+    std::vector<float> triangle_score(triangle_count);
+    for(size_t triangle = 0; triangle < triangle_count; ++triangle) {
+      triangle_score[triangle] = score[indices[triangle * 3]] + score[indices[triangle * 3 + 1]] + score[indices[triangle * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    std::vector<uint32_t> cache, next_cache;
+    size_t next_unemitted = 0;
+
+    for(size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+      // Best triangle touching the cache, or the next one in input order when nothing does.
+      int64_t best = -1;
+      float best_score = -1.0f;
+      for(uint32_t vertex : cache) {
+        for(uint32_t i = first_triangle[vertex]; i < first_triangle[vertex + 1]; ++i) {
+          const uint32_t triangle = vertex_triangles[i];
+          if(!emitted[triangle] && triangle_score[triangle] > best_score) {
+            best = triangle;
+            best_score = triangle_score[triangle];
+          }
+        }
+      }
+      if(best == -1) {
+        while(emitted[next_unemitted]) ++next_unemitted;
+        best = int64_t(next_unemitted);
+      }
+
+      emitted[best] = true;
+      const uint32_t* corners = &indices[size_t(best) * 3];
+      output.insert(output.end(), corners, corners + 3);
+
+      // The drawn triangle's vertices move to the front, the rest shift back.
+      next_cache.assign(corners, corners + 3);
+      for(uint32_t vertex : cache) {
+        if(vertex != corners[0] && vertex != corners[1] && vertex != corners[2]) next_cache.push_back(vertex);
+      }
+      // Emitted triangles stay in the vertex triangle lists and are skipped when scanning.
+      for(int i = 0; i < 3; ++i) --remaining[corners[i]];
+      for(size_t i = Cache_Size; i < next_cache.size(); ++i) cache_position[next_cache[i]] = -1;
+      if(next_cache.size() > Cache_Size) next_cache.resize(Cache_Size);
+      std::swap(cache, next_cache);
+
+      // Only vertices in the cache, and the ones that just fell out, changed score.
+      for(int position = 0; position < cache.size(); ++position) cache_position[cache[position]] = position;
+      auto rescore = [&](uint32_t vertex) {
+        const float updated = vertex_score(cache_position[vertex], remaining[vertex]);
+        const float delta = updated - score[vertex];
+        if(delta == 0.0f) return;
+        score[vertex] = updated;
+        for(uint32_t i = first_triangle[vertex]; i < first_triangle[vertex + 1]; ++i) triangle_score[vertex_triangles[i]] += delta;
+      };
+      for(uint32_t vertex : cache) rescore(vertex);
+      for(uint32_t vertex : next_cache) rescore(vertex);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+  }
+
+  // Pedro Sander, Diego Nehab, Joshua Barczak, "Fast Triangle Reordering for Vertex Locality and
+  // Reduced Overdraw". The cache optimized order is cut into clusters wherever the cache starts
+  // over, and clusters facing away from the mesh center are drawn first, so they tend to occlude
+  // the rest. Kept only when the cache miss ratio stays within threshold of the input order.
+  inline void optimize_overdraw(std::span<uint32_t> indices, std::span<const glm::vec3> positions, float threshold = 1.05f) {
+    const size_t triangle_count = indices.size() / 3;
+    if(triangle_count < 2) return;
+    constexpr size_t Cache_Size = 16;
+
+    // A triangle whose three vertices all miss starts a new cluster.
+    std::vector<size_t> cluster_starts;
+    {
+      std::vector<size_t> loaded_at(positions.size(), 0);
+      size_t time = Cache_Size + 1;
+      for(size_t triangle = 0; triangle < triangle_count; ++triangle) {
+        int misses = 0;
+        for(int corner = 0; corner < 3; ++corner) {
+          const uint32_t index = indices[triangle * 3 + corner];
+          if(time - loaded_at[index] > Cache_Size) {
+            loaded_at[index] = time++;
+            ++misses;
+          }
+        }
+        if(misses == 3 || triangle == 0) cluster_starts.push_back(triangle);
+      }
+    }
+    if(cluster_starts.size() < 2) return;
+    cluster_starts.push_back(triangle_count);
+
+    auto triangle_normal = [&](size_t triangle) {
+      const glm::vec3 a = positions[indices[triangle * 3]], b = positions[indices[triangle * 3 + 1]], c = positions[indices[triangle * 3 + 2]];
+      // Area weighted.
+      return glm::cross(b - a, c - a);
+    };
+
+    glm::vec3 mesh_center(0.0f);
+    float mesh_area = 0.0f;
+    struct Cluster {
+      size_t first{};
+      size_t end{};
+      float sort_key{};
+    };
+    std::vector<Cluster> clusters(cluster_starts.size() - 1);
+    std::vector<glm::vec3> cluster_centers(clusters.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> cluster_normals(clusters.size(), glm::vec3(0.0f));
+
+    for(size_t cluster = 0; cluster < clusters.size(); ++cluster) {
+      clusters[cluster].first = cluster_starts[cluster];
+      clusters[cluster].end = cluster_starts[cluster + 1];
+      float cluster_area = 0.0f;
+      for(size_t triangle = clusters[cluster].first; triangle < clusters[cluster].end; ++triangle) {
+        const glm::vec3 normal = triangle_normal(triangle);
+        const float area = glm::length(normal);
+        const glm::vec3 center = (positions[indices[triangle * 3]] + positions[indices[triangle * 3 + 1]] + positions[indices[triangle * 3 + 2]]) / 3.0f;
+        cluster_centers[cluster] = cluster_centers[cluster] + center * area;
+        cluster_normals[cluster] = cluster_normals[cluster] + normal;
+        cluster_area += area;
+      }
+      mesh_center = mesh_center + cluster_centers[cluster];
+      mesh_area += cluster_area;
+      if(cluster_area > 0.0f) cluster_centers[cluster] = cluster_centers[cluster] / cluster_area;
+    }
+    if(mesh_area > 0.0f) mesh_center = mesh_center / mesh_area;
+
+    for(size_t cluster = 0; cluster < clusters.size(); ++cluster) {
+      const float length = glm::length(cluster_normals[cluster]);
+      clusters[cluster].sort_key = length > 0.0f ? glm::dot(cluster_centers[cluster] - mesh_center, cluster_normals[cluster] / length) : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sort_key > b.sort_key; });
+
+    std::vector<uint32_t> reordered;
+    reordered.reserve(indices.size());
+    for(const auto& cluster : clusters) reordered.insert(reordered.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.end * 3);
+
+    const double before = analyze_vertex_cache(indices, positions.size()).acmr();
+    const double after = analyze_vertex_cache(reordered, positions.size()).acmr();
+    if(after <= before * threshold) std::copy(reordered.begin(), reordered.end(), indices.begin());
+  }
+
+  // Renumbers vertices in the order the index lists first use them and moves their bytes to match,
+  // so vertex fetch walks memory forwards. Unused vertices are dropped. Returns the new vertex count.
+  inline size_t optimize_vertex_fetch(std::span<unsigned char> vertices, size_t stride, std::span<uint32_t> indices) {
+    const size_t vertex_count = vertices.size() / stride;
+    constexpr uint32_t Unused = ~0u;
+    std::vector<uint32_t> remap(vertex_count, Unused);
+    uint32_t next = 0;
+    for(uint32_t& index : indices) {
+      if(remap[index] == Unused) remap[index] = next++;
+      index = remap[index];
+    }
+
+    std::vector<unsigned char> reordered(size_t(next) * stride);
+    for(size_t vertex = 0; vertex < vertex_count; ++vertex) {
+      if(remap[vertex] != Unused) std::memcpy(reordered.data() + size_t(remap[vertex]) * stride, vertices.data() + vertex * stride, stride);
+    }
+    std::memcpy(vertices.data(), reordered.data(), reordered.size());
+    return next;
+  }
+
+};
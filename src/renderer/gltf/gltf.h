@@ -1,455 +1,1148 @@
 #pragma once
 #include "../renderer.h"
 #include "../gl.h"
+#include "../gpu_heap.h"
+#include "../frame_ring.h"
 #include "common.h"
+#include "loader.h"
+#include "cooked.h"
+#include "../../spsc_queue.h"
 
 #include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <tiny_gltf.h>
+#include <algorithm>
+#include <functional>
 #include <span>
+#include <map>
+#include <numeric>
+#include <memory>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <bit>
+#include <array>
 
 namespace gltf {
-  struct Data {
-
-    Scene_Handle default_scene = Invalid_Scene_Handle;
-    // All Scenes, Nodes, and Meshes.
-    // NOTE: Scenes can share nodes.
-    std::vector<Scene> scenes{};
-    std::vector<Node> nodes{};
-    std::vector<Mesh> meshes{};
-    std::vector<Accessor> accessors{};
-    std::vector<Material> materials{};
-    std::vector<Texture2D> textures{};
-    std::vector<Animation> animations{};
-    std::vector<Buffer_View> buffer_views{};
+  struct Data : Loader {
 
     Material default_material{};
 
-    // NOTE: The indices map to glTF buffer view indices, not glTF buffers!
-    // gl_buffers[0] -> cgltf_data.buffer_views[0]
-    std::vector<Buffer> gl_buffers{};
-
-    Data() {
-      glGenTextures(1, reinterpret_cast<GLuint *>(&default_material.base_texture));
-      glBindTexture(GL_TEXTURE_2D, default_material.base_texture);
-      glActiveTexture(0);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-      unsigned char white_texture[4] = {255, 255, 255, 255};
+    // Vertex and index data lives in the heap, which models can share.
+    std::shared_ptr<Gpu_Heap> heap;
 
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &white_texture[0]);
+    // NOTE: The indices map to glTF buffer view indices, not glTF buffers!
+    // buffer_view_allocations[0] -> buffer_views[0]
+    std::vector<Gpu_Allocation_Handle> buffer_view_allocations{};
+
+    Upload_Stats upload_stats{};
+
+    // Per-draw data, see Draw_Data. Written once per frame instead of a handful of uniforms per draw.
+    Frame_Ring frame_ring{};
+
+    explicit Data(std::shared_ptr<Gpu_Heap> gpu_heap = std::make_shared<Gpu_Heap>()) : heap(std::move(gpu_heap)) {
+      const unsigned char white_texture[4] = {255, 255, 255, 255};
+      Texture_Format rgba8;
+      texture_format(4, 8, rgba8);
+      default_material.base_texture = int(create_texture(1, 1, rgba8, white_texture).renderer_id);
+      default_sampler = sampler_object(Sampler{});
+      texture_compression = supported_texture_compression();
+
+      std::vector<uint32_t> draw_ids(Draws_Per_Batch);
+      std::iota(draw_ids.begin(), draw_ids.end(), 0u);
+      glCreateBuffers(1, &draw_id_buffer);
+      glNamedBufferStorage(draw_id_buffer, GLsizeiptr(draw_ids.size() * sizeof(uint32_t)), draw_ids.data(), 0);
     }
 
   private:
 
-    void load_scenes(tinygltf::Model& gltf_data) {
-      for (int scene_index = 0; scene_index < gltf_data.scenes.size(); ++scene_index) {
-        auto& gltf_scene = gltf_data.scenes[scene_index];
-        auto& scene = scenes[scene_index];
-
-        scene.name = std::move(gltf_scene.name);
-        scene.nodes = std::move(gltf_scene.nodes);
+    // One entry of the draws[] storage buffer in basic.vs, std430 layout.
+    struct Draw_Data {
+      glm::mat4 model{};
+      glm::vec4 base_color{};
+      // Object to world space for normals, a std430 mat3 is three vec4 columns.
+      glm::mat3x4 normal_matrix{};
+      uint32_t octahedral_normals{};
+      uint32_t top_row_first{};
+      uint32_t has_normals{};
+      uint32_t padding{};
+    };
+    static_assert(sizeof(Draw_Data) == 144);
+
+    struct Draw_Call {
+      Vertex_Array vao{};
+      uint32_t texture{};
+      uint32_t sampler{};
+    };
+
+    // One GL sampler object per distinct glTF sampler state, the filtering and wrapping live here
+    // rather than on the textures. Render thread only.
+    std::map<Sampler, uint32_t> sampler_objects{};
+    // For untextured draws and textures without a sampler.
+    uint32_t default_sampler{};
+
+    // Filters the file leaves open are trilinear. Anisotropy only goes with mipmapped linear
+    // minification, asking for it on a nearest filter would blur pixel art.
+    uint32_t sampler_object(const Sampler& sampler) {
+      auto [it, inserted] = sampler_objects.try_emplace(sampler, 0u);
+      if(!inserted) return it->second;
+
+      const int min_filter = sampler.min_filter == -1 ? GL_LINEAR_MIPMAP_LINEAR : sampler.min_filter;
+      const int mag_filter = sampler.mag_filter == -1 ? GL_LINEAR : sampler.mag_filter;
+      glCreateSamplers(1, &it->second);
+      glSamplerParameteri(it->second, GL_TEXTURE_MIN_FILTER, min_filter);
+      glSamplerParameteri(it->second, GL_TEXTURE_MAG_FILTER, mag_filter);
+      glSamplerParameteri(it->second, GL_TEXTURE_WRAP_S, sampler.wrap_s);
+      glSamplerParameteri(it->second, GL_TEXTURE_WRAP_T, sampler.wrap_t);
+      if(min_filter == GL_LINEAR_MIPMAP_LINEAR || min_filter == GL_LINEAR_MIPMAP_NEAREST) {
+        if(const float anisotropy = max_anisotropy(); anisotropy > 1.0f) glSamplerParameterf(it->second, GL_TEXTURE_MAX_ANISOTROPY, anisotropy);
       }
+      return it->second;
     }
 
-    void load_buffer_views(const tinygltf::Model& gltf_data) {
-      for (int buffer_view_index = 0; buffer_view_index < gltf_data.bufferViews.size(); ++buffer_view_index) {
-        auto& gltf_buffer_view = gltf_data.bufferViews[buffer_view_index];
-        auto& buffer_view = buffer_views[buffer_view_index];
+    // Render thread state of a streamed image. Levels are the image's, 0 being full size.
+    struct Streamed_Image {
+      uint32_t renderer_id{};
+      // What the load uploaded, which is never dropped.
+      int coarsest_level{};
+      int resident_level{};
+      // The finest level any draw asked for this frame.
+      int wanted_level{};
+      int unwanted_frames{};
+      size_t bytes{};
+    };
+    std::vector<Streamed_Image> streamed_images{};
+    size_t streamed_bytes{};
+
+    // See set_view(). Without a view every draw asks for full size.
+    glm::vec3 camera_position{};
+    float view_projection_scale{};
+
+    static constexpr float Min_Stream_Distance = 0.01f;
+
+    // 0 for images that are uploaded whole.
+    int streamed_first_level(const Image& image) const {
+      if(!streaming.enabled || image.transcoded_format == 0) return 0;
+      int level = 0;
+      while(level + 1 < image.transcoded_levels && std::max(image.width >> level, image.height >> level) > streaming.resident_size) ++level;
+      return level;
+    }
 
-        buffer_view.byte_offset = gltf_buffer_view.byteOffset;
-        buffer_view.byte_length = gltf_buffer_view.byteLength;
-        buffer_view.byte_stride = gltf_buffer_view.byteStride;
-        buffer_view.buffer = gltf_buffer_view.buffer;
-      }
+    static size_t resident_bytes(const Image& image, int first_level) {
+      size_t bytes = 0;
+      for(int level = first_level; level < image.transcoded_levels; ++level) bytes += transcoded_level_size(image.transcoded_format, image.width, image.height, level);
+      return bytes;
     }
 
-    void load_buffer(const tinygltf::Model& gltf_data, int buffer_view_handle) {
+    // The level whose texels cover about one pixel where the mesh's bounds come closest to the
+    // camera. Texels per world unit come from the primitive's texcoord density, pixels per world
+    // unit from the projection. The bounds are final once the mesh has sub_meshes, see draw_all_scenes().
+    int required_level(const Image& image, const Mesh& mesh, const SubMesh& sub_mesh, const glm::mat4& transform) const {
+      if(view_projection_scale <= 0.0f || sub_mesh.texcoord_density <= 0.0f) return 0;
+      const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+      if(scale <= 0.0f) return 0;
+      const glm::vec3 center = glm::vec3(transform * glm::vec4((mesh.min + mesh.max) * 0.5f, 1.0f));
+      const float radius = glm::length(mesh.max - mesh.min) * 0.5f * scale;
+      const float distance = std::max(glm::length(center - camera_position) - radius, Min_Stream_Distance);
+
+      const float texels = float(std::max(image.width, image.height)) * sub_mesh.texcoord_density / scale;
+      const float pixels = view_projection_scale / distance;
+      return std::max(int(std::floor(std::log2(texels / pixels))), 0);
+    }
 
-      // If we have already uploaded the buffer before just return.
-      if(auto current_buffer = gl_buffers[buffer_view_handle]; gl_buffers[buffer_view_handle].renderer_id != 0) {
-        glBindBuffer(current_buffer.target, current_buffer.renderer_id);
-        return;
+    // Recreates the image's texture with level as its finest one. Levels both textures have are
+    // copied on the GPU, the rest come from the image's pixels. Every texture of the image switches over.
+    void restream_image(int image_index, int level) {
+      auto& streamed = streamed_images[image_index];
+      const auto& image = images[image_index];
+      const auto texture = create_transcoded_texture(image, image.pixels, level, streamed.renderer_id, streamed.resident_level);
+      for(auto& gltf_texture : textures) {
+        if(gltf_texture.renderer_id == streamed.renderer_id) gltf_texture.renderer_id = texture.renderer_id;
       }
+      // Draws already submitted keep it alive until they are done.
+      glDeleteTextures(1, &streamed.renderer_id);
+      streamed_bytes = streamed_bytes - streamed.bytes + texture.bytes;
+      streamed.renderer_id = texture.renderer_id;
+      streamed.resident_level = level;
+      streamed.unwanted_frames = 0;
+      streamed.bytes = texture.bytes;
+    }
 
-      Buffer& buffer = gl_buffers[buffer_view_handle];
-      const auto& gltf_buffer_view = gltf_data.bufferViews[buffer_view_handle];
-      const auto& gltf_buffer = gltf_data.buffers[gltf_buffer_view.buffer];
+    // After the frame's draws said what they want. Drops the levels nothing asked for in a while,
+    // then adds levels to the images missing the most detail first, within the frame's budget.
+    void stream_textures() {
+      std::vector<int> wanting;
+      for(int image_index = 0; image_index < streamed_images.size(); ++image_index) {
+        auto& streamed = streamed_images[image_index];
+        if(streamed.renderer_id == 0) continue;
+        if(streamed.wanted_level < streamed.resident_level) {
+          wanting.push_back(image_index);
+        } else if(streamed.wanted_level == streamed.resident_level) {
+          streamed.unwanted_frames = 0;
+        } else if(++streamed.unwanted_frames > streaming.evict_after_frames) {
+          restream_image(image_index, streamed.wanted_level);
+        }
+      }
+      std::ranges::sort(wanting, std::greater{}, [this](int image_index) {
+        return streamed_images[image_index].resident_level - streamed_images[image_index].wanted_level;
+      });
+
+      size_t uploaded = 0;
+      for(int image_index : wanting) {
+        const auto& streamed = streamed_images[image_index];
+        const auto& image = images[image_index];
+        auto level_size = [&image](int level) { return transcoded_level_size(image.transcoded_format, image.width, image.height, level); };
+
+        // At least one level, more while the budget allows.
+        int level = streamed.resident_level - 1;
+        size_t bytes = level_size(level);
+        while(level > streamed.wanted_level && uploaded + bytes + level_size(level - 1) <= streaming.frame_budget) bytes += level_size(--level);
+        if(uploaded > 0 && uploaded + bytes > streaming.frame_budget) break;
+        if(streamed_bytes + bytes > streaming.memory_budget) continue;
+
+        restream_image(image_index, level);
+        uploaded += bytes;
+      }
+    }
 
-      buffer.target = gltf_buffer_view.target;
-      if(gltf_buffer_view.target == 0) {
-        buffer.target = GL_ELEMENT_ARRAY_BUFFER;
+    // Every texture of an image, and of its duplicates, shares the image's GL texture, so that is
+    // what gets deleted. Restreaming replaces it.
+    void delete_textures() {
+      for(int image_index = 0; image_index < image_renderer_ids.size(); ++image_index) {
+        const bool streamed = image_index < streamed_images.size() && streamed_images[image_index].renderer_id != 0;
+        const GLuint renderer_id = streamed ? streamed_images[image_index].renderer_id : image_renderer_ids[image_index];
+        if(renderer_id != 0) glDeleteTextures(1, &renderer_id);
       }
+      const GLuint white_texture = GLuint(default_material.base_texture);
+      glDeleteTextures(1, &white_texture);
+    }
 
-      glGenBuffers(1, &buffer.renderer_id);
-      glBindBuffer(buffer.target, buffer.renderer_id);
-      glBufferData(buffer.target, gltf_buffer_view.byteLength, &gltf_buffer.data.at(0) + gltf_buffer_view.byteOffset, GL_STATIC_DRAW);
+    void create_samplers() {
+      for(auto& texture : textures) {
+        const bool has_sampler = texture.sampler >= 0 && texture.sampler < int(samplers.size());
+        texture.sampler_id = has_sampler ? sampler_object(samplers[texture.sampler]) : default_sampler;
+      }
     }
 
-    void load_accessors(tinygltf::Model& gltf_data) {
-      // Get all the data we need to configure the Vertex Attributes later on.
-      for(int accessor_index = 0; accessor_index < gltf_data.accessors.size(); ++accessor_index) {
-        auto& gltf_accessor = gltf_data.accessors[accessor_index];
-        auto& accessor = accessors[accessor_index];
+    // Shaders find their Draw_Data through a per-instance attribute that reads this buffer of
+    // 0, 1, 2, ..., offset by each draw's base instance. GL 4.5 has no gl_DrawID or gl_BaseInstance.
+    static constexpr int Draw_Id_Location = Attribute_Count;
+    static constexpr uint32_t Draws_Per_Batch = 64 * 1024;
+    uint32_t draw_id_buffer{};
 
-        accessor.buffer_view = gltf_accessor.bufferView;
-        accessor.byte_offset = gltf_accessor.byteOffset;
-        accessor.component_type = gltf_accessor.componentType;
-        accessor.type = gltf_accessor.type;
-        accessor.count = gltf_accessor.count;
+    // Reused every frame.
+    std::vector<Draw_Data> frame_draws{};
+    std::vector<Draw_Call> frame_draw_calls{};
 
-        accessor.min = std::move(gltf_accessor.minValues);
-        accessor.max = std::move(gltf_accessor.maxValues);
+    // NOTE: Exporters are allowed to leave the target out, so trust how the bufferView is used instead.
+    void load_buffer(int buffer_view_handle, Gpu_Heap::Kind kind, size_t alignment) {
+
+      // If we have already uploaded the buffer before just return.
+      if(buffer_view_allocations[buffer_view_handle] != Invalid_Gpu_Allocation_Handle) {
+        return;
       }
 
+      const auto source = buffer_view_data(buffer_view_handle);
+      if(source.empty()) return;
+
+      // Exporters repeat the same geometry a lot, under different names and bufferViews.
+      const auto key = Gpu_Heap::content_key(kind, source, alignment);
+      auto it = uploaded_contents.find(key);
+      const bool uploaded = it != uploaded_contents.end();
+      if(uploaded && std::ranges::equal(buffer_view_data(it->second.buffer_view), source)) {
+        heap->retain(it->second.allocation);
+        buffer_view_allocations[buffer_view_handle] = it->second.allocation;
+      } else if(auto shared = uploaded ? Invalid_Gpu_Allocation_Handle : heap->find_shared(key); shared != Invalid_Gpu_Allocation_Handle) {
+        uploaded_contents.emplace(key, Uploaded_Content{shared, buffer_view_handle});
+        buffer_view_allocations[buffer_view_handle] = shared;
+      } else {
+        // Bytes that only share the digest with an earlier bufferView get their own allocation.
+        const auto allocation = heap->allocate(kind, source.size(), alignment);
+        heap->write(allocation, source);
+        if(!uploaded) uploaded_contents.emplace(key, Uploaded_Content{allocation, buffer_view_handle});
+        buffer_view_allocations[buffer_view_handle] = allocation;
+
+        ++upload_stats.buffers;
+        upload_stats.buffer_bytes += source.size();
+        return;
+      }
+      ++upload_stats.shared_buffers;
+      upload_stats.shared_buffer_bytes += source.size();
     }
 
-    void load_textures(const tinygltf::Model& gltf_data) {
-      for (int texture_index = 0; texture_index < gltf_data.textures.size(); ++texture_index) {
-        auto& texture = textures[texture_index];
-        const auto& gltf_texture = gltf_data.textures[texture_index];
-        const auto& gltf_image = gltf_data.images[gltf_texture.source];
-
-        glGenTextures(1, &texture.renderer_id);
-        glBindTexture(GL_TEXTURE_2D, texture.renderer_id);
-        glActiveTexture(0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // What this model put in the heap, by contents, and the first bufferView with those bytes. Shared
+    // with other models once the load finished.
+    struct Uploaded_Content {
+      Gpu_Allocation_Handle allocation = Invalid_Gpu_Allocation_Handle;
+      Buffer_View_Handle buffer_view = Invalid_Buffer_View_Handle;
+    };
+    std::map<Gpu_Heap::Content_Key, Uploaded_Content> uploaded_contents{};
+
+    // Per image, its GL texture once uploaded with its size in VRAM, and the duplicates (see
+    // Loader::image_source()) that were uploaded before it and wait for it.
+    std::vector<uint32_t> image_renderer_ids{};
+    std::vector<size_t> image_texture_bytes{};
+    std::vector<std::vector<int>> waiting_duplicates{};
+
+    void publish_image_texture(int image_index, uint32_t renderer_id) {
+      for(int texture_index : image_textures[image_index]) publish({Upload::Kind::Texture, texture_index, renderer_id});
+    }
 
-        GLenum format{};
-        switch (gltf_image.component) {
-          case 1: { format = GL_RED;  break; }
-          case 2: { format = GL_RG;   break; }
-          case 3: { format = GL_RGB;  break; }
-          case 4: { format = GL_RGBA; break; }
-          default: {
-            std::cout << "Unknown texture_format: " << format << std::endl;
-          }
+    // One GL texture per distinct image, which every texture that samples it uses. Frees the decoded pixels.
+    // Upload thread only, so the duplicates bookkeeping needs no lock.
+    void upload_image(int image_index) {
+      auto& image = images[image_index];
+      if(const int source = image_source(image_index); source != image_index) {
+        ++upload_stats.shared_textures;
+        if(image_renderer_ids[source] != 0) {
+          publish_image_texture(image_index, image_renderer_ids[source]);
+          upload_stats.shared_texture_bytes += image_texture_bytes[source];
+        } else {
+          waiting_duplicates[source].push_back(image_index);
         }
+        return;
+      }
 
-        GLenum type{};
-        switch (gltf_image.bits) {
-          case 16: { type = GL_UNSIGNED_SHORT; break; }
-          case 8:  { type = GL_UNSIGNED_BYTE;  break; }
-          default: {
-            std::cout << "Unknown texture size: " << gltf_image.bits << std::endl;
-          }
+      const std::string name = image.name.empty() ? image.uri.substr(0, 64) : image.name;
+      if(image.pixels.empty()) {
+        std::cout << "  image " << image_index << " '" << name << "' has no pixels" << std::endl;
+      } else {
+        const int first_level = streamed_first_level(image);
+        image.streamed = first_level > 0;
+        const auto texture = upload_texture(image, image.pixels, first_level);
+        std::cout << "  image " << image_index << " '" << name << "' " << image.width << "x" << image.height << " " << texture.format_name << ", "
+                  << texture.levels << " mips" << (image.streamed ? " streamed in later, " : ", ") << texture.bytes / 1024.0 << " KiB VRAM, decoded in "
+                  << image_decode_milliseconds[image_index] << " ms" << std::endl;
+
+        image_renderer_ids[image_index] = texture.renderer_id;
+        image_texture_bytes[image_index] = texture.bytes;
+        publish_image_texture(image_index, texture.renderer_id);
+        for(int duplicate : waiting_duplicates[image_index]) {
+          publish_image_texture(duplicate, texture.renderer_id);
+          upload_stats.shared_texture_bytes += texture.bytes;
         }
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gltf_image.width, gltf_image.height, 0, format, type, &gltf_image.image.at(0));
-
       }
+      // The GPU has it now, unless it is streamed.
+      if(retention != Retention::Full && !image.streamed) std::vector<unsigned char>().swap(image.pixels);
     }
 
-    void load_materials(const tinygltf::Model& gltf_data) {
-      for (int material_index = 0; material_index < gltf_data.materials.size(); ++material_index) {
-        auto& material = materials[material_index];
-        const auto& gltf_material = gltf_data.materials[material_index];
-
-        // Capture the base color
-        for(int i = 0; i < gltf_material.pbrMetallicRoughness.baseColorFactor.size(); ++i) {
-          std::vector base_color = gltf_material.pbrMetallicRoughness.baseColorFactor;
-          material.base_color[i] = gltf_material.pbrMetallicRoughness.baseColorFactor[i];
+    // How decoded pixels are stored on the GPU. One and two channel images are sampled as grey and
+    // grey with alpha, the same as if the decoder had expanded them to RGBA.
+    struct Texture_Format {
+      GLenum internal_format{};
+      GLenum format{};
+      GLenum type{};
+      int bytes_per_pixel{};
+      std::array<GLint, 4> swizzle{GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+      const char* name{};
+    };
+
+    static bool texture_format(int components, int bits, Texture_Format& format) {
+      if(bits != 8 && bits != 16) return false;
+      const bool wide = bits == 16;
+      const GLenum type = wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+      switch (components) {
+        case 1: {
+          format = {GLenum(wide ? GL_R16 : GL_R8), GL_RED, type, wide ? 2 : 1, {GL_RED, GL_RED, GL_RED, GL_ONE}, wide ? "R16" : "R8"};
+          return true;
+        }
+        case 2: {
+          format = {GLenum(wide ? GL_RG16 : GL_RG8), GL_RG, type, wide ? 4 : 2, {GL_RED, GL_RED, GL_RED, GL_GREEN}, wide ? "RG16" : "RG8"};
+          return true;
+        }
+        case 4: {
+          format = {GLenum(wide ? GL_RGBA16 : GL_RGBA8), GL_RGBA, type, wide ? 8 : 4, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}, wide ? "RGBA16" : "RGBA8"};
+          return true;
         }
-        // Capture the base texture
-        material.base_texture = gltf_material.pbrMetallicRoughness.baseColorTexture.index;
-
       }
+      return false;
     }
 
-    void load_mesh(tinygltf::Model& gltf_data) {
-      for (int mesh_index = 0; mesh_index < gltf_data.meshes.size(); ++mesh_index) {
-        auto& mesh = meshes[mesh_index];
-        const auto& gltf_mesh = gltf_data.meshes[mesh_index];
+    struct Texture_Upload {
+      uint32_t renderer_id{};
+      int levels{};
+      size_t bytes{};
+      const char* format_name = "";
+    };
+
+    // The largest anisotropy textures are sampled with, capped by what the driver allows.
+    static constexpr float Max_Anisotropy = 16.0f;
+
+    // Immutable storage with a full mip chain, generated on the GPU from level 0. Filtering and
+    // wrapping come from the sampler object bound with it. Nothing is bound, so neither the upload
+    // context nor the render thread's texture units are disturbed.
+    static Texture_Upload create_texture(int width, int height, const Texture_Format& format, const void* pixels) {
+      Texture_Upload texture;
+      texture.levels = std::bit_width(unsigned(std::max({width, height, 1})));
+      texture.format_name = format.name;
+      for(int level = 0; level < texture.levels; ++level) {
+        texture.bytes += size_t(std::max(width >> level, 1)) * std::max(height >> level, 1) * format.bytes_per_pixel;
+      }
 
-        for(int primitive_index = 0; primitive_index < gltf_mesh.primitives.size(); ++primitive_index) {
-          const auto& gltf_primitive = gltf_mesh.primitives[primitive_index];
-          Vertex_Array vao;
-          glGenVertexArrays(1, &vao.renderer_id);
-          glBindVertexArray(vao.renderer_id);
+      glCreateTextures(GL_TEXTURE_2D, 1, &texture.renderer_id);
+      glTextureParameteriv(texture.renderer_id, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle.data());
 
-          auto accessor_draw_count = 0;
-          for (auto& gltf_attribute : gltf_primitive.attributes) {
-            auto slot = -1;
-            if (gltf_attribute.first == "POSITION") slot = 0;
-            if (gltf_attribute.first == "NORMAL") slot = 1;
-            if (gltf_attribute.first == "TEXCOORD_0") slot = 2;
-            if (gltf_attribute.first == "JOINTS_0") slot = 3;
-            if (gltf_attribute.first == "WEIGHTS_0") slot = 4;
-            if (slot <= -1) {
-              continue;
-            }
+      glTextureStorage2D(texture.renderer_id, texture.levels, format.internal_format, width, height);
+      // Rows of one and two channel images aren't 4 byte aligned.
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTextureSubImage2D(texture.renderer_id, 0, 0, 0, width, height, format.format, format.type, pixels);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      if(texture.levels > 1) glGenerateTextureMipmap(texture.renderer_id);
+      return texture;
+    }
 
-            auto accessors = this->accessors[gltf_attribute.second];
-            load_buffer(gltf_data, gltf_data.accessors[gltf_attribute.second].bufferView);
-
-            auto& gltf_accessor = gltf_data.accessors[gltf_attribute.second];
-            int byte_stride = gltf_accessor.ByteStride(gltf_data.bufferViews[gltf_accessor.bufferView]);
-            glEnableVertexAttribArray(slot);
-            glVertexAttribPointer(slot,
-                                  (tinygltf::GetNumComponentsInType(accessors.type)),
-                                  (accessors.component_type),
-                                  gltf_accessor.normalized ? GL_TRUE : GL_FALSE,
-                                  byte_stride,
-                                  BUFFER_OFFSET(gltf_accessor.byteOffset));
-            accessor_draw_count = int(gltf_accessor.count);
-          }
+    // GL_TEXTURE_MAX_ANISOTROPY is core in 4.6 and ARB_texture_filter_anisotropic before. Without
+    // it the query fails and leaves 0, and samplers stay trilinear.
+    static float max_anisotropy() {
+      static const float anisotropy = [] {
+        GLfloat supported = 0.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &supported);
+        while(glGetError() != GL_NO_ERROR) {}
+        return std::min(supported, Max_Anisotropy);
+      }();
+      return anisotropy;
+    }
 
-          if(gltf_primitive.indices <= -1) {
-            vao.has_indices = false;
-            // When we are not working with indexed geometry, then use the accessor count which should be the same for each attribute's accessor.
-            vao.count = accessor_draw_count;
-            vao.primitive_mode = static_cast<Primitive_Mode>((int) gltf_primitive.mode);
+    // KTX2 and BCn encoded images arrive with their mip levels, those are uploaded as they are.
+    // Streamed images start at first_level, their texture's level 0 is that level of the image.
+    // Levels copy_from already holds, from its copy_from_level on, are copied on the GPU instead.
+    static Texture_Upload create_transcoded_texture(const Image& gltf_image, std::span<const unsigned char> pixels, int first_level = 0,
+                                                    uint32_t copy_from = 0, int copy_from_level = 0) {
+      const unsigned int format = gltf_image.transcoded_format;
+      Texture_Upload texture;
+      texture.levels = gltf_image.transcoded_levels - first_level;
+      texture.format_name = transcoded_format_name(format);
+
+      glCreateTextures(GL_TEXTURE_2D, 1, &texture.renderer_id);
+      if(format == GL_COMPRESSED_RG_RGTC2) {
+        // BC5 only holds grey with alpha.
+        const std::array<GLint, 4> swizzle = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+        glTextureParameteriv(texture.renderer_id, GL_TEXTURE_SWIZZLE_RGBA, swizzle.data());
+      }
+      glTextureStorage2D(texture.renderer_id, texture.levels, format, std::max(gltf_image.width >> first_level, 1), std::max(gltf_image.height >> first_level, 1));
+
+      size_t offset = 0;
+      for(int level = 0; level < gltf_image.transcoded_levels; ++level) {
+        const size_t size = transcoded_level_size(format, gltf_image.width, gltf_image.height, level);
+        const int width = std::max(gltf_image.width >> level, 1);
+        const int height = std::max(gltf_image.height >> level, 1);
+        const int texture_level = level - first_level;
+        if(texture_level >= 0) {
+          if(copy_from != 0 && level >= copy_from_level) {
+            glCopyImageSubData(copy_from, GL_TEXTURE_2D, level - copy_from_level, 0, 0, 0, texture.renderer_id, GL_TEXTURE_2D, texture_level, 0, 0, 0, width, height, 1);
+          } else if(format == GL_RGBA8) {
+            glTextureSubImage2D(texture.renderer_id, texture_level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data() + offset);
           } else {
-            vao.has_indices = true;
-            auto indices_accessor = accessors[gltf_primitive.indices];
-            load_buffer(gltf_data, indices_accessor.buffer_view);
-            auto indices_buffer = gl_buffers[indices_accessor.buffer_view];
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_buffer.renderer_id);
-            vao.indices_component_type = static_cast<Component_Type>(indices_accessor.component_type);
-            vao.primitive_mode = static_cast<Primitive_Mode>((int) gltf_primitive.mode);
-            vao.count = indices_accessor.count;
-            vao.offset = indices_accessor.byte_offset;
+            glCompressedTextureSubImage2D(texture.renderer_id, texture_level, 0, 0, width, height, format, GLsizei(size), pixels.data() + offset);
           }
-          SubMesh sub_mesh;
-          sub_mesh.vao = vao;
-          sub_mesh.material = gltf_primitive.material;
-          mesh.sub_meshes.push_back(sub_mesh);
+          texture.bytes += size;
         }
-
+        offset += size;
       }
+      return texture;
+    }
 
+    // BC7 is core since GL 4.2, so the fallbacks are for drivers that leave it out anyway.
+    static Texture_Compression supported_texture_compression() {
+      auto supported = [](GLenum internal_format) {
+        GLint result = GL_FALSE;
+        glGetInternalformativ(GL_TEXTURE_2D, internal_format, GL_INTERNALFORMAT_SUPPORTED, 1, &result);
+        return result == GL_TRUE;
+      };
+      if(supported(GL_COMPRESSED_RGBA_BPTC_UNORM)) return Texture_Compression::Bc7;
+      if(supported(GL_COMPRESSED_RGB_S3TC_DXT1_EXT) && supported(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)) return Texture_Compression::Bc1_Bc3;
+      return Texture_Compression::None;
     }
 
+    Texture_Upload upload_texture(const Image& gltf_image, std::span<const unsigned char> pixels, int first_level = 0) {
+      if(gltf_image.transcoded_format != 0) {
+        auto texture = create_transcoded_texture(gltf_image, pixels, first_level);
+        ++upload_stats.textures;
+        upload_stats.texture_bytes += texture.bytes;
+        return texture;
+      }
+      Texture_Format format;
+      if(!texture_format(gltf_image.component, gltf_image.bits, format)) {
+        std::cout << "Unsupported image format: " << gltf_image.component << " channels of " << gltf_image.bits << " bits" << std::endl;
+        return {};
+      }
+      auto texture = create_texture(gltf_image.width, gltf_image.height, format, pixels.data());
+      ++upload_stats.textures;
+      upload_stats.texture_bytes += texture.bytes;
+      return texture;
+    }
 
-    void load_nodes(tinygltf::Model& gltf_data) {
-      for(int node_index = 0; node_index < gltf_data.nodes.size(); ++node_index) {
-        auto& gltf_node = gltf_data.nodes[node_index];
-        auto& node = nodes[node_index];
+    // A Vertex_Layout once its bufferViews are placed in the heap. bufferViews of the same arena
+    // only differ in the base vertex here, so their primitives end up sharing a VAO.
+    struct Placed_Attribute {
+      uint32_t buffer{};
+      int component_type{};
+      int components{};
+      bool normalized{};
+      int byte_stride{};
+      size_t byte_offset{};
+
+      auto operator<=>(const Placed_Attribute&) const = default;
+    };
+
+    struct Placed_Layout {
+      std::array<Placed_Attribute, Attribute_Count> attributes{};
+      uint32_t index_buffer{};
+
+      auto operator<=>(const Placed_Layout&) const = default;
+    };
+
+    // Primitives with an equal placed layout share one VAO, across all meshes.
+    std::map<Placed_Layout, uint32_t> vertex_arrays{};
+    // The heap generation the VAOs and draw offsets were made for.
+    uint64_t vertex_arrays_generation{};
+    std::vector<bool> uploaded_meshes{};
+
+    // Upload thread. Buffer objects are shared between contexts, so they can be created here.
+    void upload_mesh_buffers(int mesh_index) {
+      for(const auto& [layout, vao, material, quantized, texcoord_density] : prepared_meshes[mesh_index]) {
+        for(const auto& attribute : layout.attributes) {
+          // Stride aligned, so the bufferView starts on a whole vertex of the arena.
+          if(attribute.buffer_view != Invalid_Buffer_View_Handle) load_buffer(attribute.buffer_view, Gpu_Heap::Kind::Vertex, std::lcm(size_t(attribute.byte_stride), size_t(4)));
+        }
+        if(layout.indices_buffer_view != Invalid_Buffer_View_Handle) load_buffer(layout.indices_buffer_view, Gpu_Heap::Kind::Index, 4);
+      }
+    }
 
-        node.name = std::move(gltf_node.name);
-        node.children = std::move(gltf_node.children);
-        node.mesh = gltf_node.mesh;
+    // Render thread. VAOs are not shared between contexts, so they are always made here.
+    // prepared_meshes is kept, a compaction of the heap places everything anew.
+    void upload_mesh(int mesh_index) {
+      auto& mesh = meshes[mesh_index];
+      mesh.sub_meshes.clear();
+      mesh.sub_meshes.reserve(prepared_meshes[mesh_index].size());
+
+      for(const auto& [layout, vao, material, quantized, texcoord_density] : prepared_meshes[mesh_index]) {
+        SubMesh sub_mesh;
+        sub_mesh.vao = vao;
+        sub_mesh.material = material;
+        sub_mesh.quantized = quantized;
+        sub_mesh.texcoord_density = texcoord_density;
+
+        const Placed_Layout placed = place_layout(layout, sub_mesh.vao);
+        sub_mesh.has_normals = placed.attributes[Normal].buffer != 0;
+        if(auto it = vertex_arrays.find(placed); it != vertex_arrays.end()) {
+          sub_mesh.vao.renderer_id = it->second;
+        } else {
+          sub_mesh.vao.renderer_id = create_vertex_array(placed);
+          vertex_arrays.emplace(placed, sub_mesh.vao.renderer_id);
+        }
+        mesh.sub_meshes.push_back(sub_mesh);
+      }
 
-        glm::mat4 translation_mat4(1.0f);
-        glm::mat4 rotation_mat4(1.0f);
-        glm::mat4 scale_mat4(1.0f);
-        glm::mat4 gltf_matrix(1.0f);
+      uploaded_meshes[mesh_index] = true;
+    }
 
-        if(!gltf_node.translation.empty()) {
-          translation_mat4[3][0] = gltf_node.translation[0];
-          translation_mat4[3][1] = gltf_node.translation[1];
-          translation_mat4[3][2] = gltf_node.translation[2];
-        }
+    // Turns the bufferView relative layout into arena offsets. The base vertex becomes the
+    // primitive's first vertex in the arena, counted in the stride of the attribute that starts
+    // lowest. Every other attribute keeps the rest as its binding offset, which is only zero for
+    // all of them when they share one interleaved bufferView.
+    Placed_Layout place_layout(const Vertex_Layout& layout, Vertex_Array& vao) const {
+      Placed_Layout placed;
+      std::array<size_t, Attribute_Count> first_byte{};
+      int64_t base_vertex = -1;
+
+      for(int slot = 0; slot < Attribute_Count; ++slot) {
+        const auto& attribute = layout.attributes[slot];
+        if(attribute.buffer_view == Invalid_Buffer_View_Handle) continue;
+        const auto allocation = buffer_view_allocations[attribute.buffer_view];
+        if(allocation == Invalid_Gpu_Allocation_Handle || attribute.byte_stride <= 0) continue;
+
+        const auto placement = heap->placement(allocation);
+        first_byte[slot] = placement.offset + attribute.byte_offset + size_t(vao.base_vertex) * attribute.byte_stride;
+        placed.attributes[slot] = {placement.buffer, attribute.component_type, attribute.components, attribute.normalized, attribute.byte_stride, 0};
+
+        const int64_t first_vertex = int64_t(first_byte[slot] / attribute.byte_stride);
+        if(base_vertex == -1 || first_vertex < base_vertex) base_vertex = first_vertex;
+      }
 
-        if(!gltf_node.rotation.empty()) {
-          // glTF Quat = (x, y, z, w)
-          // glm Quat constructor = (w, x, y, z)
-          glm::quat tmp_quat(gltf_node.rotation[3], gltf_node.rotation[0], gltf_node.rotation[1], gltf_node.rotation[2]);
-          rotation_mat4 = glm::mat4_cast(tmp_quat);
+      if(base_vertex != -1) {
+        for(int slot = 0; slot < Attribute_Count; ++slot) {
+          auto& attribute = placed.attributes[slot];
+          if(attribute.buffer != 0) attribute.byte_offset = first_byte[slot] - size_t(base_vertex) * attribute.byte_stride;
         }
+        vao.base_vertex = int(base_vertex);
+      }
 
-        if(!gltf_node.scale.empty()) {
-          scale_mat4[0][0] = gltf_node.scale[0];
-          scale_mat4[1][1] = gltf_node.scale[1];
-          scale_mat4[2][2] = gltf_node.scale[2];
+      if(layout.indices_buffer_view != Invalid_Buffer_View_Handle) {
+        const auto allocation = buffer_view_allocations[layout.indices_buffer_view];
+        if(allocation != Invalid_Gpu_Allocation_Handle) {
+          const auto placement = heap->placement(allocation);
+          placed.index_buffer = placement.buffer;
+          vao.offset += int(placement.offset);
         }
+      }
+      return placed;
+    }
 
-        if(!gltf_node.matrix.empty()) {
-          gltf_matrix = glm::make_mat4(&gltf_node.matrix[0]);
-
-          glm::quat rot{};
-          glm::vec3 scale{}, skew{}, translation{};
-          glm::vec4 perpsective;
-          glm::decompose(gltf_matrix, scale, rot, translation, skew, perpsective);
-
-          translation_mat4[3][0] = translation[0];
-          translation_mat4[3][1] = translation[1];
-          translation_mat4[3][2] = translation[2];
-          rotation_mat4 = glm::mat4_cast(rot);
-          scale_mat4[0][0] = scale[0];
-          scale_mat4[1][1] = scale[1];
-          scale_mat4[2][2] = scale[2];
+    uint32_t create_vertex_array(const Placed_Layout& layout) {
+      uint32_t renderer_id{};
+      glCreateVertexArrays(1, &renderer_id);
+      ++upload_stats.vertex_arrays;
+
+      // One binding per attribute slot, the placed offset goes on the binding.
+      for(int slot = 0; slot < layout.attributes.size(); ++slot) {
+        const auto& attribute = layout.attributes[slot];
+        if(attribute.buffer == 0) continue;
+
+        glEnableVertexArrayAttrib(renderer_id, slot);
+        glVertexArrayVertexBuffer(renderer_id, slot, attribute.buffer, GLintptr(attribute.byte_offset), attribute.byte_stride);
+        glVertexArrayAttribBinding(renderer_id, slot, slot);
+        // Joint indices stay integers. Everything else reaches the shader as floats, which is also how
+        // KHR_mesh_quantization wants its unnormalized integer positions and texcoords read.
+        if(slot == Joints_0 && !attribute.normalized) {
+          glVertexArrayAttribIFormat(renderer_id, slot, attribute.components, attribute.component_type, 0);
+        } else {
+          glVertexArrayAttribFormat(renderer_id, slot, attribute.components, attribute.component_type, attribute.normalized ? GL_TRUE : GL_FALSE, 0);
         }
+      }
+
+      if(layout.index_buffer != 0) {
+        glVertexArrayElementBuffer(renderer_id, layout.index_buffer);
+      }
 
+      glEnableVertexArrayAttrib(renderer_id, Draw_Id_Location);
+      glVertexArrayVertexBuffer(renderer_id, Draw_Id_Location, draw_id_buffer, 0, sizeof(uint32_t));
+      glVertexArrayBindingDivisor(renderer_id, Draw_Id_Location, 1);
+      glVertexArrayAttribBinding(renderer_id, Draw_Id_Location, Draw_Id_Location);
+      glVertexArrayAttribIFormat(renderer_id, Draw_Id_Location, 1, GL_UNSIGNED_INT, 0);
 
-        node.translation = translation_mat4;
-        node.rotation = rotation_mat4;
-        node.scale = scale_mat4;
+      return renderer_id;
+    }
 
+    void delete_vertex_arrays() {
+      for(const auto& [layout, renderer_id] : vertex_arrays) glDeleteVertexArrays(1, &renderer_id);
+      vertex_arrays.clear();
+    }
 
-        if(node.mesh != Invalid_Mesh_Handle) load_mesh(gltf_data);
+    // Render thread, after the heap was compacted by any model sharing it.
+    void replace_vertex_arrays() {
+      delete_vertex_arrays();
+      vertex_arrays_generation = heap->generation();
+      for(int mesh_index = 0; mesh_index < uploaded_meshes.size(); ++mesh_index) {
+        if(uploaded_meshes[mesh_index]) upload_mesh(mesh_index);
       }
     }
 
-    void load_animations(tinygltf::Model& gltf_data) {
+    // Compaction has to wait until this model's buffers are written, see Gpu_Heap::end_upload().
+    bool heap_upload_open = false;
 
-      for (int animation_index = 0; animation_index < gltf_data.animations.size(); ++animation_index) {
-        auto& gltf_animation = gltf_data.animations[animation_index];
-        auto& animation = animations[animation_index];
+    void begin_heap_upload() {
+      heap->begin_upload();
+      heap_upload_open = true;
+    }
 
-        animation.channels.resize(gltf_animation.channels.size());
+    void end_heap_upload() {
+      if(!heap_upload_open) return;
+      heap_upload_open = false;
+      heap->end_upload();
+    }
+
+    // Something the upload side finished that the render thread may now use.
+    struct Upload {
+      enum class Kind {
+        Scene,
+        Mesh,
+        Texture,
+        Finished,
+      };
+
+      Kind kind{};
+      int index{};
+      uint32_t renderer_id{};
+      GLsync fence{};
+    };
+
+    // Async loads only. The loader thread is the single producer, the render thread the single consumer.
+    bool async = false;
+    bool loading = false;
+    bool scene_ready = false;
+    GLFWwindow* upload_window = nullptr;
+    std::thread loader{};
+    Spsc_Queue<Upload> published_uploads{};
+
+    // Synchronous loads apply right away. Async ones are fenced so the render thread only
+    // sees objects the upload context has finished writing.
+    void publish(Upload upload) {
+      if(!async) {
+        apply_upload(upload);
+        return;
+      }
+      upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      // Without a flush the fence may never reach the GPU and the render thread would wait forever.
+      glFlush();
+      published_uploads.push(upload);
+    }
+
+    void apply_upload(const Upload& upload) {
+      switch (upload.kind) {
+        case Upload::Kind::Scene: {
+          create_samplers();
+          scene_ready = true;
+          total_meshes = int(meshes.size());
+          total_textures = int(textures.size());
+          break;
+        }
+        case Upload::Kind::Mesh: {
+          upload_mesh(upload.index);
+          ++visible_meshes;
+          break;
+        }
+        case Upload::Kind::Texture: {
+          auto& texture = textures[upload.index];
+          const int image_index = image_source(texture.source);
+          texture.renderer_id = upload.renderer_id;
+          texture.top_row_first = images[image_index].top_row_first;
+          if(images[image_index].streamed) {
+            auto& streamed = streamed_images[image_index];
+            if(streamed.renderer_id == 0) {
+              const int level = streamed_first_level(images[image_index]);
+              streamed = {upload.renderer_id, level, level, level, 0, resident_bytes(images[image_index], level)};
+              streamed_bytes += streamed.bytes;
+            }
+            // Textures of duplicate images may only arrive after it was restreamed.
+            texture.renderer_id = streamed.renderer_id;
+          }
+          ++visible_textures;
+          break;
+        }
+        case Upload::Kind::Finished: {
+          if(loader.joinable()) loader.join();
+          if(upload_window != nullptr) {
+            glfwDestroyWindow(upload_window);
+            upload_window = nullptr;
+          }
+          loading = false;
+          end_heap_upload();
+          // Everything this load wrote is visible to every context now.
+          for(const auto& [key, content] : uploaded_contents) heap->share(key, content.allocation);
+          const auto heap_stats = heap->stats();
+          std::cout << "glTF upload: " << upload_stats.vertex_arrays << " vertex arrays, "
+                    << upload_stats.buffers << " buffers, " << upload_stats.buffer_bytes << " bytes, "
+                    << upload_stats.textures << " textures, " << upload_stats.texture_bytes << " bytes of VRAM. GPU heap: "
+                    << heap_stats.allocations << " allocations in " << heap_stats.arenas << " arenas, "
+                    << heap_stats.used_bytes << " / " << heap_stats.capacity_bytes << " bytes used" << std::endl;
+          const auto memory = memory_stats();
+          std::cout << "glTF CPU memory kept: " << memory.total() << " bytes (buffers " << memory.buffer_bytes << ", images "
+                    << memory.image_bytes << ", scene " << memory.scene_bytes << ")" << std::endl;
+          if(upload_stats.shared_buffers > 0 || upload_stats.shared_textures > 0) {
+            std::cout << "glTF dedup: " << upload_stats.shared_buffers << " bufferViews (" << upload_stats.shared_buffer_bytes << " bytes) and "
+                      << upload_stats.shared_textures << " images (" << upload_stats.shared_texture_bytes << " bytes) reused instead of uploaded" << std::endl;
+          }
+          if(const auto streamed_count = std::ranges::count_if(images, &Image::streamed); streamed_count > 0) {
+            std::cout << "glTF texture streaming: " << streamed_count << " images start at " << streaming.resident_size << " pixels, "
+                      << streamed_bytes / 1024.0 << " KiB resident" << std::endl;
+          }
+          break;
+        }
+      }
+    }
 
-        //animation.name = std::move(gltf_animation.name);
+    // Everything the render thread reads once it sees the scene has to be sized before.
+    void publish_scene() {
+      buffer_view_allocations.assign(buffer_views.size(), Invalid_Gpu_Allocation_Handle);
+      image_renderer_ids.assign(images.size(), 0);
+      image_texture_bytes.assign(images.size(), 0);
+      waiting_duplicates.assign(images.size(), {});
+      streamed_images.assign(images.size(), {});
+      uploaded_meshes.assign(meshes.size(), false);
+      vertex_arrays_generation = heap->generation();
+      publish({Upload::Kind::Scene});
+    }
 
-        for(int channel_index = 0; channel_index < gltf_animation.channels.size(); ++channel_index) {
-          auto& gltf_channel = gltf_animation.channels[channel_index];
-          auto& channel = animation.channels[channel_index];
+    bool load_parsed(const std::string& path) {
+      load_failed = false;
+      if(!validate_buffer_views()) {
+        std::cout << "Failed to load glTF buffers: " << path << std::endl;
+        load_failed = true;
+      } else {
+        begin_heap_upload();
+        run_load_graph([this](int image_index) { upload_image(image_index); }, [this](int mesh_index) {
+          upload_mesh_buffers(mesh_index);
+          publish({Upload::Kind::Mesh, mesh_index});
+        });
+      }
 
-          if (gltf_channel.target_path == "translation") channel.target_path = Target_Path::Translation;
-          if (gltf_channel.target_path == "rotation") channel.target_path = Target_Path::Rotation;
-          if (gltf_channel.target_path == "scale") channel.target_path = Target_Path::Scale;
-          if (gltf_channel.target_path == "weights") channel.target_path = Target_Path::Weights;
+      release_sources();
+      if(load_failed) std::cout << "glTF file loaded with errors: " << path << std::endl;
+      publish({Upload::Kind::Finished});
+      return !load_failed;
+    }
 
-          channel.target_node = Node_Handle(gltf_channel.target_node);
-          auto& gltf_sampler = gltf_animation.samplers[gltf_channel.sampler];
+  public:
+    // Loads a .gltf or .glb file. Either way the file is mapped rather than read into memory.
+    bool load(const std::string& path) {
+      if(!parse_file(path)) return false;
 
-          if(gltf_sampler.interpolation == "LINEAR") channel.interpolation = Interpolation::Linear;
+      publish_scene();
+      return load_parsed(path);
+    }
 
-          auto& input_buffer_accessor = accessors[gltf_sampler.input];
-          auto& output_buffer_accessor = accessors[gltf_sampler.output];
+    // Loads a blob written by gltf_cook. The blob is mapped and uploaded as is, nothing is parsed or decoded.
+    bool load_cooked(const std::string& path) {
+      if(!source_file.open(path)) {
+        std::cout << "Failed to open cooked glTF file: " << path << std::endl;
+        return false;
+      }
+      const auto blob = source_file.bytes();
+
+      cooked::Header header{};
+      if(blob.size() >= sizeof(header)) std::memcpy(&header, blob.data(), sizeof(header));
+      if(header.magic != cooked::Magic || header.version != cooked::Version || header.header_size != sizeof(header)) {
+        std::cout << "Not a cooked glTF file of version " << cooked::Version << ", recook it: " << path << std::endl;
+        release_sources();
+        return false;
+      }
 
-          auto& gltf_input_buffer_accessor = gltf_data.accessors[gltf_sampler.input];
-          auto& gltf_output_buffer_accessor = gltf_data.accessors[gltf_sampler.output];
-          auto& gltf_input_buffer_bufferview= gltf_data.bufferViews[input_buffer_accessor.buffer_view];
-          auto& gltf_output_buffer_bufferview = gltf_data.bufferViews[output_buffer_accessor.buffer_view];
+      if(!cooked::table_fits<cooked::Scene>(blob, header.scenes) || !cooked::table_fits<uint32_t>(blob, header.scene_nodes) ||
+         !cooked::table_fits<cooked::Node>(blob, header.nodes) || !cooked::table_fits<uint32_t>(blob, header.node_children) ||
+         !cooked::table_fits<cooked::Mesh>(blob, header.meshes) || !cooked::table_fits<cooked::Primitive>(blob, header.primitives) ||
+         !cooked::table_fits<cooked::Material>(blob, header.materials) || !cooked::table_fits<cooked::Texture>(blob, header.textures) ||
+         !cooked::table_fits<cooked::Sampler>(blob, header.samplers) ||
+         !cooked::table_fits<cooked::Image>(blob, header.images) || !cooked::table_fits<cooked::Buffer_View>(blob, header.buffer_views) ||
+         !cooked::table_fits<cooked::Animation>(blob, header.animations) || !cooked::table_fits<cooked::Channel>(blob, header.channels) ||
+         !cooked::table_fits<cooked::Frame>(blob, header.frames) || !cooked::table_fits<char>(blob, header.strings)) {
+        std::cout << "Cooked glTF file is truncated: " << path << std::endl;
+        release_sources();
+        return false;
+      }
 
-          Buffer& input_buffer = gl_buffers[accessors[gltf_sampler.input].buffer_view];
-          Buffer& output_buffer = gl_buffers[accessors[gltf_sampler.output].buffer_view];
+      const auto strings = cooked::table<char>(blob, header.strings);
+      auto string = [&](cooked::String name) {
+        if(name.offset > strings.size() || name.length > strings.size() - name.offset) return std::string();
+        return std::string(strings.data() + name.offset, name.length);
+      };
+      // Indices into the tables are checked once here so drawing can trust them.
+      auto in_range = [](auto first, auto count, size_t size) { return first <= size && count <= size - first; };
+
+      const auto scene_nodes = cooked::table<uint32_t>(blob, header.scene_nodes);
+      const auto node_children = cooked::table<uint32_t>(blob, header.node_children);
+      const auto cooked_nodes = cooked::table<cooked::Node>(blob, header.nodes);
+      const auto cooked_meshes = cooked::table<cooked::Mesh>(blob, header.meshes);
+      const auto cooked_primitives = cooked::table<cooked::Primitive>(blob, header.primitives);
+      const auto cooked_buffer_views = cooked::table<cooked::Buffer_View>(blob, header.buffer_views);
+      const auto cooked_images = cooked::table<cooked::Image>(blob, header.images);
+      const auto cooked_channels = cooked::table<cooked::Channel>(blob, header.channels);
+      const auto cooked_frames = cooked::table<cooked::Frame>(blob, header.frames);
+      bool valid = true;
+
+      default_scene = header.default_scene;
+      for(const auto& cooked_scene : cooked::table<cooked::Scene>(blob, header.scenes)) {
+        auto& scene = scenes.emplace_back();
+        scene.name = string(cooked_scene.name);
+        if(!in_range(cooked_scene.first_node, cooked_scene.node_count, scene_nodes.size())) { valid = false; continue; }
+        for(auto node : scene_nodes.subspan(cooked_scene.first_node, cooked_scene.node_count)) {
+          if(node < cooked_nodes.size()) scene.nodes.push_back(Node_Handle(node)); else valid = false;
+        }
+      }
 
-          const auto gltf_input_buffer = gltf_data.buffers[gltf_data.bufferViews[gltf_input_buffer_accessor.bufferView].buffer];
-          const auto gltf_output_buffer = gltf_data.buffers[gltf_data.bufferViews[gltf_output_buffer_accessor.bufferView].buffer];
+      for(const auto& cooked_node : cooked_nodes) {
+        auto& node = nodes.emplace_back();
+        node.name = string(cooked_node.name);
+        node.mesh = cooked_node.mesh >= 0 && cooked_node.mesh < cooked_meshes.size() ? cooked_node.mesh : Invalid_Mesh_Handle;
+        node.translation = glm::make_mat4(cooked_node.translation);
+        node.rotation = glm::make_mat4(cooked_node.rotation);
+        node.scale = glm::make_mat4(cooked_node.scale);
+        if(!in_range(cooked_node.first_child, cooked_node.child_count, node_children.size())) { valid = false; continue; }
+        for(auto child : node_children.subspan(cooked_node.first_child, cooked_node.child_count)) {
+          if(child < cooked_nodes.size()) node.children.push_back(Node_Handle(child)); else valid = false;
+        }
+      }
 
-          input_buffer.data.resize(gltf_data.bufferViews[gltf_input_buffer_accessor.bufferView].byteLength);
-          output_buffer.data.resize(gltf_data.bufferViews[gltf_output_buffer_accessor.bufferView].byteLength);
+      for(const auto& cooked_material : cooked::table<cooked::Material>(blob, header.materials)) {
+        auto& material = materials.emplace_back();
+        material.base_color = glm::make_vec4(cooked_material.base_color);
+        material.base_texture = cooked_material.base_texture;
+      }
+      const auto cooked_textures = cooked::table<cooked::Texture>(blob, header.textures);
+      for(auto& material : materials) {
+        if(material.base_texture >= int(cooked_textures.size())) material.base_texture = -1;
+      }
 
-          int num_of_components = tinygltf::GetNumComponentsInType(gltf_output_buffer_accessor.type);
-          auto time_steps_buffer = std::span(std::next(gltf_input_buffer.data.begin(), gltf_input_buffer_bufferview.byteOffset + input_buffer_accessor.byte_offset), input_buffer_accessor.count * sizeof(float));
-          auto transform_buffer = std::span(std::next(gltf_output_buffer.data.begin(), gltf_output_buffer_bufferview.byteOffset + output_buffer_accessor.byte_offset), output_buffer_accessor.count * sizeof(float) * num_of_components);
-          const auto* time_steps_buffer_f32 = reinterpret_cast<const float*>(time_steps_buffer.data());
-          const auto* transform_buffer_f32 = reinterpret_cast<const float*>(transform_buffer.data());
+      for(const auto& cooked_texture : cooked_textures) {
+        textures.push_back({0, cooked_texture.source, cooked_texture.sampler});
+      }
+      for(const auto& cooked_sampler : cooked::table<cooked::Sampler>(blob, header.samplers)) {
+        samplers.push_back({cooked_sampler.mag_filter, cooked_sampler.min_filter, cooked_sampler.wrap_s, cooked_sampler.wrap_t});
+      }
 
-          for (int i = 0; i < input_buffer_accessor.count; ++i) {
-            Frame frame;
+      for(const auto& cooked_image : cooked_images) {
+        auto& image = images.emplace_back();
+        image.name = string(cooked_image.name);
+        image.width = cooked_image.width;
+        image.height = cooked_image.height;
+        image.component = cooked_image.component;
+        image.bits = cooked_image.bits;
+        image.transcoded_format = cooked_image.transcoded_format;
+        image.transcoded_levels = cooked_image.transcoded_levels;
+        image.top_row_first = cooked_image.top_row_first != 0;
+        uint64_t size = uint64_t(image.width) * image.height * image.component * (image.bits / 8);
+        if(image.transcoded_format != 0) {
+          if(image.transcoded_levels < 1 || image.transcoded_levels > 32) valid = false;
+          size = 0;
+          for(int level = 0; level < image.transcoded_levels; ++level) size += transcoded_level_size(image.transcoded_format, image.width, image.height, level);
+        }
+        if(!cooked::range_fits(blob, cooked_image.pixels) || cooked_image.pixels.size < size) valid = false;
+      }
 
-            frame.time = time_steps_buffer_f32[i];
+      // One buffer: the blob itself. Every bufferView points straight into the mapping.
+      auto& buffer = buffers.emplace_back();
+      buffer.byte_length = blob.size();
+      buffer.bytes = blob;
+      for(const auto& cooked_buffer_view : cooked_buffer_views) {
+        if(!cooked::range_fits(blob, cooked_buffer_view.bytes)) valid = false;
+        buffer_views.push_back({0, size_t(cooked_buffer_view.bytes.offset), size_t(cooked_buffer_view.bytes.size)});
+      }
 
-            if(channel.target_path == gltf::Target_Path::Translation) {
-              frame.translation = glm::vec3(transform_buffer_f32[i * num_of_components + 0], transform_buffer_f32[i * num_of_components + 1], transform_buffer_f32[i * num_of_components + 2]);
-            } else if(channel.target_path == gltf::Target_Path::Rotation) {
-              frame.rotation = glm::quat(transform_buffer_f32[i * num_of_components + 3], transform_buffer_f32[i * num_of_components + 0], transform_buffer_f32[i * num_of_components + 1], transform_buffer_f32[i * num_of_components + 2]);
-            } else if(channel.target_path == gltf::Target_Path::Scale) {
-              std::cout << "FIXME: Implement Scaling Animations." << std::endl;
-            } else if(channel.target_path == gltf::Target_Path::Weights) {
-              std::cout << "FIXME: Implement Weight Animations." << std::endl;
-            }
+      prepared_meshes.resize(cooked_meshes.size());
+      for(int mesh_index = 0; mesh_index < cooked_meshes.size(); ++mesh_index) {
+        const auto& cooked_mesh = cooked_meshes[mesh_index];
+        auto& mesh = meshes.emplace_back();
+        mesh.name = string(cooked_mesh.name);
+        mesh.min = glm::make_vec3(cooked_mesh.min);
+        mesh.max = glm::make_vec3(cooked_mesh.max);
+        mesh.dequantization = glm::make_mat4(cooked_mesh.dequantization);
+        if(!in_range(cooked_mesh.first_primitive, cooked_mesh.primitive_count, cooked_primitives.size())) { valid = false; continue; }
+
+        for(const auto& cooked_primitive : cooked_primitives.subspan(cooked_mesh.first_primitive, cooked_mesh.primitive_count)) {
+          auto& [layout, vao, material, quantized, texcoord_density] = prepared_meshes[mesh_index].emplace_back();
+          auto check_buffer_view = [&](int buffer_view) {
+            if(buffer_view != Invalid_Buffer_View_Handle && (buffer_view < 0 || buffer_view >= cooked_buffer_views.size())) valid = false;
+            return buffer_view;
+          };
+          for(int slot = 0; slot < Attribute_Count; ++slot) {
+            const auto& attribute = cooked_primitive.attributes[slot];
+            layout.attributes[slot] = {check_buffer_view(attribute.buffer_view), attribute.component_type, attribute.components,
+                                       attribute.normalized != 0, attribute.byte_stride, attribute.byte_offset};
+          }
+          layout.indices_buffer_view = check_buffer_view(cooked_primitive.indices_buffer_view);
+          vao.primitive_mode = Primitive_Mode(cooked_primitive.mode);
+          vao.has_indices = cooked_primitive.has_indices != 0;
+          vao.indices_component_type = Component_Type(cooked_primitive.indices_component_type);
+          vao.count = cooked_primitive.count;
+          vao.offset = cooked_primitive.offset;
+          vao.base_vertex = cooked_primitive.base_vertex;
+          material = cooked_primitive.material < int(materials.size()) ? cooked_primitive.material : -1;
+          quantized = cooked_primitive.quantized != 0;
+          texcoord_density = cooked_primitive.texcoord_density;
+        }
+      }
 
-            channel.frames.push_back(frame);
+      for(const auto& cooked_animation : cooked::table<cooked::Animation>(blob, header.animations)) {
+        auto& animation = animations.emplace_back();
+        animation.name = string(cooked_animation.name);
+        animation.total_animation_duration = cooked_animation.duration;
+        if(!in_range(cooked_animation.first_channel, cooked_animation.channel_count, cooked_channels.size())) { valid = false; continue; }
+
+        for(const auto& cooked_channel : cooked_channels.subspan(cooked_animation.first_channel, cooked_animation.channel_count)) {
+          auto& channel = animation.channels.emplace_back();
+          channel.target_node = cooked_channel.target_node;
+          if(channel.target_node < Invalid_Node_Handle || channel.target_node >= int(cooked_nodes.size())) valid = false;
+          channel.target_path = Target_Path(cooked_channel.target_path);
+          channel.interpolation = Interpolation(cooked_channel.interpolation);
+          channel.start_time = cooked_channel.start_time;
+          channel.end_time = cooked_channel.end_time;
+          if(!in_range(cooked_channel.first_frame, cooked_channel.frame_count, cooked_frames.size())) { valid = false; continue; }
+
+          channel.frames.reserve(cooked_channel.frame_count);
+          for(const auto& cooked_frame : cooked_frames.subspan(cooked_channel.first_frame, cooked_channel.frame_count)) {
+            auto& frame = channel.frames.emplace_back();
+            frame.time = cooked_frame.time;
+            frame.translation = glm::make_vec3(cooked_frame.translation);
+            // glTF Quat = (x, y, z, w)
+            // glm Quat constructor = (w, x, y, z)
+            frame.rotation = glm::quat(cooked_frame.rotation[3], cooked_frame.rotation[0], cooked_frame.rotation[1], cooked_frame.rotation[2]);
+            frame.scale = glm::make_vec3(cooked_frame.scale);
           }
+        }
+      }
+
+      if(!valid) {
+        std::cout << "Cooked glTF file is corrupt: " << path << std::endl;
+        release_sources();
+        return false;
+      }
+
+      publish_scene();
 
-          animation.total_animation_duration = std::max(animation.total_animation_duration, time_steps_buffer_f32[input_buffer_accessor.count - 1]);
-          channel.start_time = channel.frames.front().time;
-          channel.end_time = channel.frames.back().time;
+      begin_heap_upload();
+      for(int mesh_index = 0; mesh_index < meshes.size(); ++mesh_index) {
+        upload_mesh_buffers(mesh_index);
+        publish({Upload::Kind::Mesh, mesh_index});
+      }
+
+      // The cooker stores equal pixels once, so equal images share a range and a texture.
+      std::map<uint64_t, uint32_t> range_textures;
+      for(int texture_index = 0; texture_index < textures.size(); ++texture_index) {
+        int source = textures[texture_index].source;
+        if(source < 0 || source >= images.size()) continue;
+        const auto& pixels = cooked_images[source].pixels;
+        auto [it, inserted] = range_textures.emplace(pixels.offset, 0);
+        if(inserted) {
+          const auto& image = images[source];
+          const auto texture = upload_texture(image, blob.subspan(pixels.offset, pixels.size));
+          std::cout << "  image " << source << " '" << image.name << "' " << image.width << "x" << image.height << " " << texture.format_name << ", "
+                    << texture.levels << " mips, " << texture.bytes / 1024.0 << " KiB VRAM" << std::endl;
+          it->second = texture.renderer_id;
+          image_renderer_ids[source] = texture.renderer_id;
+          image_texture_bytes[source] = texture.bytes;
         }
+        publish({Upload::Kind::Texture, texture_index, it->second});
+      }
+
+      release_sources();
+      publish({Upload::Kind::Finished});
+      return true;
+    }
 
+    // Returns right away and loads on a background thread, which uploads through a hidden window
+    // whose context is shared with main_window. Call process_uploads() once per frame, meshes and
+    // textures show up as their uploads complete.
+    void load_async(const std::string& path, GLFWwindow* main_window) {
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+      upload_window = glfwCreateWindow(1, 1, "glTF upload", nullptr, main_window);
+      glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+      glfwMakeContextCurrent(main_window);
+
+      if(upload_window == nullptr) {
+        std::cout << "Failed to create the glTF upload context, loading synchronously." << std::endl;
+        load(path);
+        return;
       }
+
+      async = true;
+      loading = true;
+      loader = std::thread([this, path] {
+        glfwMakeContextCurrent(upload_window);
+
+        if(parse_file(path)) {
+          publish_scene();
+          load_parsed(path);
+        } else {
+          load_failed = true;
+          publish({Upload::Kind::Finished});
+        }
+
+        glfwMakeContextCurrent(nullptr);
+      });
     }
 
-    void internal_gltf_load(tinygltf::Model& gltf_data) {
-      scenes.resize(gltf_data.scenes.size());
-      meshes.resize(gltf_data.meshes.size());
-      nodes.resize(gltf_data.nodes.size());
-      accessors.resize(gltf_data.accessors.size());
-      gl_buffers.resize(gltf_data.bufferViews.size());
-      buffer_views.resize(gltf_data.bufferViews.size());
-      materials.resize(gltf_data.materials.size());
-      textures.resize(gltf_data.textures.size());
-      animations.resize(gltf_data.animations.size());
+    // Render thread. Makes every upload whose fence has signaled visible, in the order they were
+    // published. Never blocks: anything the GPU hasn't finished yet waits for the next frame.
+    void process_uploads() {
+      if(!async) return;
 
-      load_buffer_views(gltf_data);
-      load_accessors(gltf_data);
-      load_textures(gltf_data);
-      load_materials(gltf_data);
-      load_nodes(gltf_data);
-      load_scenes(gltf_data);
-      load_animations(gltf_data);
-      //gltf_data.default_scene = find_cgltf_scene_index(cgltf_data.scene, cgltf_data)
+      while(Upload* upload = published_uploads.front()) {
+        if(upload->fence != nullptr) {
+          if(glClientWaitSync(upload->fence, 0, 0) == GL_TIMEOUT_EXPIRED) break;
+          glDeleteSync(upload->fence);
+        }
+        apply_upload(*upload);
+        published_uploads.pop();
+      }
     }
 
-  public:
-    void load(const std::string& path) {
-      tinygltf::TinyGLTF loader;
-      tinygltf::Model data;
-      std::string err;
-      std::string warn;
+    bool is_loading() const {
+      return loading;
+    }
 
-      bool res = loader.LoadASCIIFromFile(&data, &err, &warn, path);
+    // Load progress for the render thread, the totals are known once the scene is published.
+    int visible_meshes{};
+    int visible_textures{};
+    int total_meshes{};
+    int total_textures{};
+
+    ~Data() {
+      if(loader.joinable()) loader.join();
+      if(upload_window != nullptr) glfwDestroyWindow(upload_window);
+      while(Upload* upload = published_uploads.front()) {
+        if(upload->fence != nullptr) glDeleteSync(upload->fence);
+        published_uploads.pop();
+      }
 
-      internal_gltf_load(data);
+      delete_vertex_arrays();
+      delete_textures();
+      glDeleteBuffers(1, &draw_id_buffer);
+      for(const auto& [sampler, sampler_id] : sampler_objects) glDeleteSamplers(1, &sampler_id);
+      end_heap_upload();
+      for(auto allocation : buffer_view_allocations) {
+        if(allocation != Invalid_Gpu_Allocation_Handle) heap->free(allocation);
+      }
+      // Close the holes for the models still using the heap, they pick up the new placements on their next draw.
+      if(heap.use_count() > 1) heap->compact();
     }
 
     float time = 0.0f;
 
+    // The camera texture streaming measures demand from, once per frame before draw_all_scenes().
+    void set_view(const glm::vec3& position, const glm::mat4& projection) {
+      GLint viewport[4]{};
+      glGetIntegerv(GL_VIEWPORT, viewport);
+      camera_position = position;
+      // Pixels one world unit covers at distance 1.
+      view_projection_scale = projection[1][1] * float(viewport[3]) * 0.5f;
+    }
+
+    // Gathers every draw first, so the frame's Draw_Data goes to the ring in one copy. The draws
+    // themselves only bind what changed and pass their index as the base instance.
     void draw_all_scenes(unsigned int shader) {
+      // Async loads fill in the scene on another thread until it is published.
+      if(!scene_ready) return;
+      if(vertex_arrays_generation != heap->generation()) replace_vertex_arrays();
+
+      frame_draws.clear();
+      frame_draw_calls.clear();
+      for(auto& streamed : streamed_images) streamed.wanted_level = streamed.coarsest_level;
+
       std::function<void(const Node&, const glm::mat4&)> draw_node;
-      draw_node = [&draw_node, this, &shader](const Node& node, const glm::mat4& transform) {
+      draw_node = [&draw_node, this](const Node& node, const glm::mat4& transform) {
 
         if(node.mesh == Invalid_Mesh_Handle) {
 
         } else {
-          auto mesh = meshes[node.mesh];
-
-          for(auto sub_mesh : mesh.sub_meshes) { // Start
-            glBindVertexArray(sub_mesh.vao.renderer_id);
-            // TRS
-            auto model = transform;
-
-            Material material;
-            if(sub_mesh.material == -1) {
-              material = default_material;
-
-              glBindTexture(GL_TEXTURE_2D, material.base_texture);
-              glActiveTexture(0);
-
-              glUniform1i(glGetUniformLocation(shader, "tex_slot"), 0);
-            } else {
-              material = materials[sub_mesh.material];
-
-              if(material.base_texture > -1) {
-                Texture2D &base_texture = textures[material.base_texture];
-                glBindTexture(GL_TEXTURE_2D, base_texture.renderer_id);
-                glActiveTexture(0);
-
-                glUniform1i(glGetUniformLocation(shader, "tex_slot"), 0);
+          // Only sub_meshes and what prepare_mesh() wrote before the mesh's upload, dequantization and the
+          // bounds required_level() reads, may be read here. sub_meshes stays empty until that upload is applied.
+          const auto& mesh = meshes[node.mesh];
+
+          for(const auto& sub_mesh : mesh.sub_meshes) { // Start
+            const Material& material = sub_mesh.material == -1 ? default_material : materials[sub_mesh.material];
+            uint32_t texture = GLuint(default_material.base_texture);
+            uint32_t sampler = default_sampler;
+            bool top_row_first = false;
+            if(sub_mesh.material != -1 && material.base_texture > -1) {
+              // Still streaming in, draw untextured until then.
+              const Texture2D& base_texture = textures[material.base_texture];
+              if(base_texture.renderer_id != 0) {
+                texture = base_texture.renderer_id;
+                sampler = base_texture.sampler_id;
+                top_row_first = base_texture.top_row_first;
+                if(const int image_index = image_source(base_texture.source); images[image_index].streamed) {
+                  auto& streamed = streamed_images[image_index];
+                  streamed.wanted_level = std::min(streamed.wanted_level, required_level(images[image_index], mesh, sub_mesh, transform));
+                }
               }
             }
 
-            auto identity = glm::mat4(1.0f);
-            glUniformMatrix4fv(glGetUniformLocation(shader, "u_model"), 1, GL_FALSE, &model[0][0]);
-            glUniformMatrix4fv(glGetUniformLocation(shader, "u_animation_channel_1"), 1, GL_FALSE, &identity[0][0]);
-            glUniform4fv(glGetUniformLocation(shader, "u_base_color"), 1, &material.base_color[0]);
-
-            if(sub_mesh.vao.has_indices) {
-              glDrawElements(
-                static_cast<GLenum>(sub_mesh.vao.primitive_mode),
-                sub_mesh.vao.count,
-                static_cast<GLenum>(sub_mesh.vao.indices_component_type),
-                // The byte offset FROM the start of the buffer view.
-                reinterpret_cast<const void *>(uintptr_t(sub_mesh.vao.offset)));
-            } else {
-              glDrawArrays(static_cast<GLenum>(sub_mesh.vao.primitive_mode), 0, (sub_mesh.vao.count));
-            }
+            // TRS
+            Draw_Data& draw = frame_draws.emplace_back();
+            draw.model = sub_mesh.quantized ? transform * mesh.dequantization : transform;
+            draw.base_color = material.base_color;
+            // The cofactor matrix is the inverse transpose up to a scale, which the shader normalizes away.
+            const glm::mat3 linear(transform);
+            draw.normal_matrix = glm::mat3x4(glm::mat3(glm::cross(linear[1], linear[2]), glm::cross(linear[2], linear[0]), glm::cross(linear[0], linear[1])));
+            draw.octahedral_normals = sub_mesh.quantized;
+            draw.top_row_first = top_row_first;
+            draw.has_normals = sub_mesh.has_normals;
+            frame_draw_calls.push_back({sub_mesh.vao, texture, sampler});
           }
 
         } // End
 
         for(int child_node_handle : node.children) {
-          auto child_node = nodes[child_node_handle];
+          const auto& child_node = nodes[child_node_handle];
           draw_node(child_node, transform * (child_node.translation * child_node.rotation * child_node.scale) * child_node.animation_transform);
         }
 
@@ -457,12 +1150,57 @@ namespace gltf {
 
       for(const auto& scene : scenes) {
         for(auto scene_node_handle : scene.nodes) {
-          auto node = nodes[scene_node_handle];
+          const auto& node = nodes[scene_node_handle];
           draw_node(node, (node.translation * node.rotation * node.scale) * node.animation_transform);
         }
       }
+      if(frame_draws.empty()) return;
+
+      const size_t bytes = frame_draws.size() * sizeof(Draw_Data);
+      const auto region = frame_ring.begin_frame(bytes);
+      std::memcpy(region.data, frame_draws.data(), bytes);
+
+      glUniform1i(glGetUniformLocation(shader, "tex_slot"), 0);
+      uint32_t bound_vao = 0, bound_texture = 0, bound_sampler = 0;
+      for(size_t first = 0; first < frame_draw_calls.size(); first += Draws_Per_Batch) {
+        const size_t count = std::min<size_t>(Draws_Per_Batch, frame_draw_calls.size() - first);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, frame_ring.buffer(), GLintptr(region.offset + first * sizeof(Draw_Data)), GLsizeiptr(count * sizeof(Draw_Data)));
+
+        for(uint32_t draw_id = 0; draw_id < count; ++draw_id) {
+          const auto& [vao, texture, sampler] = frame_draw_calls[first + draw_id];
+          if(vao.renderer_id != bound_vao) {
+            glBindVertexArray(vao.renderer_id);
+            bound_vao = vao.renderer_id;
+          }
+          if(texture != bound_texture) {
+            glBindTextureUnit(0, texture);
+            bound_texture = texture;
+          }
+          if(sampler != bound_sampler) {
+            glBindSampler(0, sampler);
+            bound_sampler = sampler;
+          }
 
+          if(vao.has_indices) {
+            glDrawElementsInstancedBaseVertexBaseInstance(
+              static_cast<GLenum>(vao.primitive_mode),
+              vao.count,
+              static_cast<GLenum>(vao.indices_component_type),
+              // The byte offset FROM the start of the buffer view.
+              reinterpret_cast<const void *>(uintptr_t(vao.offset)),
+              1,
+              vao.base_vertex,
+              draw_id);
+          } else {
+            glDrawArraysInstancedBaseInstance(static_cast<GLenum>(vao.primitive_mode), vao.base_vertex, vao.count, 1, draw_id);
+          }
+        }
+      }
+      // Other renderers sample unit 0 with their textures' own parameters.
+      glBindSampler(0, 0);
+      frame_ring.end_frame();
+      // The draws above already captured the textures they sample.
+      stream_textures();
     }
-
   };
 };
\ No newline at end of file
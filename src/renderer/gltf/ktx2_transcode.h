@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../gl.h"
+#include "common.h"
+
+#include <basisu_transcoder.h>
+
+#include <span>
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+// KHR_texture_basisu through the Basis Universal transcoder. KTX2 images hold ETC1S or UASTC data
+// that is transcoded straight to a block format the GPU samples from, every mip level the file
+// has, so neither the CPU nor the GPU ever holds the uncompressed pixels.
+
+namespace gltf {
+
+  // What KTX2 images are transcoded to. Bc7 is core since GL 4.2, Bc1_Bc3 picks BC1 for opaque
+  // and BC3 for images with alpha, None transcodes to RGBA8.
+  enum class Texture_Compression {
+    Bc7,
+    Bc1_Bc3,
+    None,
+  };
+
+  inline bool is_ktx2(std::span<const unsigned char> encoded) {
+    static constexpr unsigned char Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    return encoded.size() >= sizeof(Identifier) && std::memcmp(encoded.data(), Identifier, sizeof(Identifier)) == 0;
+  }
+
+  inline const char* transcoded_format_name(unsigned int format) {
+    switch (format) {
+      case GL_COMPRESSED_RGBA_BPTC_UNORM:    return "BC7";
+      case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:  return "BC1";
+      case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+      case GL_COMPRESSED_RG_RGTC2:           return "BC5";
+    }
+    return "RGBA8";
+  }
+
+  // Fills image's size, pixels and transcoded format and levels. On failure error says why.
+  // Safe to call from several threads at once, each with its own image.
+  inline bool ktx2_transcode(std::span<const unsigned char> encoded, Texture_Compression compression, Image& image, std::string& error) {
+    static const bool initialized = [] {
+      basist::basisu_transcoder_init();
+      return true;
+    }();
+    (void)initialized;
+
+    basist::ktx2_transcoder transcoder;
+    if(!transcoder.init(encoded.data(), uint32_t(encoded.size()))) {
+      error = "not a valid KTX2 file";
+      return false;
+    }
+    if(transcoder.get_faces() != 1 || transcoder.get_layers() > 1) {
+      error = "only 2D KTX2 textures are supported, not cube maps or arrays";
+      return false;
+    }
+    if(!transcoder.start_transcoding()) {
+      error = "the KTX2 file has no Basis Universal data";
+      return false;
+    }
+
+    basist::transcoder_texture_format target = basist::transcoder_texture_format::cTFRGBA32;
+    image.transcoded_format = GL_RGBA8;
+    if(compression == Texture_Compression::Bc7) {
+      target = basist::transcoder_texture_format::cTFBC7_RGBA;
+      image.transcoded_format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+    } else if(compression == Texture_Compression::Bc1_Bc3 && transcoder.get_has_alpha()) {
+      target = basist::transcoder_texture_format::cTFBC3_RGBA;
+      image.transcoded_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    } else if(compression == Texture_Compression::Bc1_Bc3) {
+      target = basist::transcoder_texture_format::cTFBC1_RGB;
+      image.transcoded_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+
+    image.width = int(transcoder.get_width());
+    image.height = int(transcoder.get_height());
+    image.component = 4;
+    image.bits = 8;
+    image.top_row_first = true;
+    image.transcoded_levels = int(std::max(transcoder.get_levels(), 1u));
+
+    size_t total = 0;
+    for(int level = 0; level < image.transcoded_levels; ++level) {
+      total += transcoded_level_size(image.transcoded_format, image.width, image.height, level);
+    }
+    image.pixels.resize(total);
+
+    // Sizes are in blocks for the BCn formats and in pixels for RGBA8.
+    const size_t unit = basist::basis_get_bytes_per_block_or_pixel(target);
+    size_t offset = 0;
+    for(int level = 0; level < image.transcoded_levels; ++level) {
+      const size_t size = transcoded_level_size(image.transcoded_format, image.width, image.height, level);
+      if(!transcoder.transcode_image_level(uint32_t(level), 0, 0, image.pixels.data() + offset, uint32_t(size / unit), target)) {
+        error = "mip level " + std::to_string(level) + " failed to transcode";
+        image.pixels.clear();
+        return false;
+      }
+      offset += size;
+    }
+    return true;
+  }
+
+};
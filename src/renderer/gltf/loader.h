@@ -0,0 +1,1570 @@
+#pragma once
+#include "../gl.h"
+#include "../content_hash.h"
+#include "common.h"
+#include "mapped_file.h"
+#include "file_system.h"
+#include "parser.h"
+#include "base64.h"
+#include "meshopt_decode.h"
+#include "draco_decode.h"
+#include "ktx2_transcode.h"
+#include "texture_encode.h"
+#include "accessor_view.h"
+#include "quantize.h"
+#include "geometry_optimizer.h"
+#include "../../thread_pool.h"
+#include "../../task_graph.h"
+
+#include <span>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <tuple>
+
+namespace gltf {
+
+  // The CPU half of loading a glTF file: parsing, reading buffers, decoding images, working out
+  // vertex layouts and extracting animations. It never calls GL, so tools can use it without a context.
+  struct Loader : Asset {
+
+    // A primitive with everything worked out except its VAO.
+    struct Prepared_Primitive {
+      Vertex_Layout layout{};
+      Vertex_Array vao{};
+      int material{};
+      // Positions need Mesh::dequantization and normals are octahedral.
+      bool quantized{};
+      // See SubMesh::texcoord_density.
+      float texcoord_density{};
+    };
+
+    // One entry per mesh, filled in by prepare_mesh().
+    std::vector<std::vector<Prepared_Primitive>> prepared_meshes{};
+
+    // Where external buffer and image files come from. Swap it to read from an archive, a cache or the network.
+    File_System file_system = default_file_system();
+
+    // Load-time vertex repacking. Each primitive gets one tightly interleaved stream with only the
+    // attributes a shader reads, instead of binding whatever bufferViews the exporter chose.
+    // Component formats are kept. Set before loading.
+    struct Repack_Options {
+      bool enabled = false;
+      // What basic.vs reads: POSITION, NORMAL, TEXCOORD_0.
+      std::array<bool, Attribute_Count> attributes = {true, true, true, false, false};
+      // Keeps JOINTS_0 and WEIGHTS_0 as well, for primitives that have both.
+      bool skinned = false;
+      // Also shrinks float attributes while repacking: POSITION to unorm16 within the mesh bounds
+      // (see Mesh::dequantization), NORMAL to octahedral snorm16 and TEXCOORD_0 to half floats.
+      // Primitives that are already quantized (KHR_mesh_quantization) are copied as they are.
+      bool quantize = false;
+      // Also welds, reorders and renumbers the vertices and triangles of triangle list streams for
+      // the post-transform cache, overdraw and vertex fetch, and narrows their indices to 16 bits
+      // where the vertex count allows. See geometry_optimizer.h.
+      bool optimize = false;
+    };
+
+    Repack_Options repack{};
+
+    // What stays in CPU memory once the GPU has everything. Set before loading.
+    enum class Retention {
+      // The scene only: nodes, meshes, materials, animations.
+      None,
+      // Also the vertex and index bytes that were uploaded, for picking and bounds. buffer_view_data()
+      // still returns them, every other bufferView is empty.
+      Geometry,
+      // Also every buffer and the decoded pixels of every image.
+      Full,
+    };
+
+    Retention retention = Retention::None;
+
+    // The block format KTX2 images are transcoded to. gltf::Data picks the best one its context
+    // samples from. Set before loading.
+    Texture_Compression texture_compression = Texture_Compression::Bc7;
+
+    // Encodes PNG and JPEG images to BCn on the workers after decoding, for assets that can't be
+    // re-exported with KTX2. Skipped when texture_compression is None. Set before loading.
+    struct Texture_Encode_Options {
+      bool enabled = false;
+      // BC7 for color images when texture_compression allows it. Otherwise BC1 for opaque images
+      // and BC3 for images with alpha. Grey with alpha is always BC5.
+      bool bc7 = true;
+      // Encoded images are kept here by the hash of their file bytes and these settings, and later
+      // loads read them back instead of decoding and encoding. Empty for no cache.
+      std::string cache_directory{};
+    };
+
+    Texture_Encode_Options texture_encode{};
+
+    // Mip streaming for KTX2 and BCn encoded images, the ones that arrive with their mip chain.
+    // gltf::Data uploads only their smallest levels, draw_all_scenes() adds finer ones as the draws
+    // that sample them get close enough to need them, see set_view(). Loads only measure the
+    // primitives' texcoord density with it enabled. Set before loading.
+    struct Streaming_Options {
+      bool enabled = false;
+      // Images start with the levels up to this size.
+      int resident_size = 64;
+      // Texture bytes uploaded per frame. The first upload of a frame always goes, however large.
+      size_t frame_budget = 4 * 1024 * 1024;
+      // Streamed textures stay within this much VRAM. Finer levels wait until others are dropped.
+      size_t memory_budget = 512 * 1024 * 1024;
+      // Frames a texture's finest levels go unneeded before they are dropped again.
+      int evict_after_frames = 300;
+    };
+
+    Streaming_Options streaming{};
+
+    // CPU bytes a loaded model holds on to, by what they are. Capacities, not sizes.
+    struct Memory_Stats {
+      size_t buffer_bytes{};
+      size_t image_bytes{};
+      // Everything else: scene graph, meshes and their prepared layouts, accessors, animations.
+      size_t scene_bytes{};
+
+      size_t total() const {
+        return buffer_bytes + image_bytes + scene_bytes;
+      }
+    };
+
+    Memory_Stats memory_stats() const {
+      auto bytes = [](const auto& vector) { return vector.capacity() * sizeof(vector[0]); };
+      Memory_Stats stats;
+      for(const auto& buffer : buffers) stats.buffer_bytes += bytes(buffer.owned) + buffer.uri.capacity();
+      for(const auto& image : images) stats.image_bytes += bytes(image.pixels) + image.uri.capacity() + image.name.capacity();
+
+      stats.scene_bytes = bytes(scenes) + bytes(nodes) + bytes(meshes) + bytes(accessors) + bytes(materials) + bytes(textures) +
+                          bytes(images) + bytes(animations) + bytes(buffer_views) + bytes(buffers) + bytes(prepared_meshes);
+      for(const auto& scene : scenes) stats.scene_bytes += bytes(scene.nodes);
+      for(const auto& node : nodes) stats.scene_bytes += bytes(node.children) + node.name.capacity();
+      for(const auto& mesh : meshes) stats.scene_bytes += bytes(mesh.primitives) + bytes(mesh.sub_meshes) + mesh.name.capacity();
+      for(const auto& prepared : prepared_meshes) stats.scene_bytes += bytes(prepared);
+      for(const auto& animation : animations) {
+        stats.scene_bytes += bytes(animation.channels) + bytes(animation.samplers);
+        for(const auto& channel : animation.channels) stats.scene_bytes += bytes(channel.frames);
+      }
+      return stats;
+    }
+
+    // Runs every CPU stage on path and keeps the sources around, for tools that write them out.
+    bool load_sources(const std::string& path) {
+      if(!parse_file(path)) return false;
+      load_failed = false;
+      if(!validate_buffer_views()) return false;
+      run_load_graph({}, {});
+      return !load_failed;
+    }
+
+    // The image whose pixels stand for this one: itself, or another image with the same encoded
+    // bytes that was decoded in its place. The duplicate's own pixels stay empty.
+    int image_source(int image_index) const {
+      return image_index < image_originals.size() && image_originals[image_index] != -1 ? image_originals[image_index] : image_index;
+    }
+
+    // False for images no texture samples, which are never read or decoded.
+    bool image_used(int image_index) const {
+      return image_index < image_textures.size() && !image_textures[image_index].empty();
+    }
+
+    std::span<const unsigned char> buffer_view_data(Buffer_View_Handle buffer_view_handle) const {
+      const auto& buffer_view = buffer_views[buffer_view_handle];
+      if(buffer_view.buffer < 0 || buffer_view.buffer >= buffers.size()) return {};
+      const auto& bytes = buffers[buffer_view.buffer].bytes;
+      if(buffer_view.byte_offset + buffer_view.byte_length > bytes.size()) return {};
+      return bytes.subspan(buffer_view.byte_offset, buffer_view.byte_length);
+    }
+
+    // Quantized attributes are plain normalized or integer vertex formats, GL fetches them as they are.
+    // Compressed bufferViews and primitives are decoded while loading.
+    static constexpr std::string_view Supported_Extensions[] = {"KHR_mesh_quantization", "EXT_meshopt_compression", "KHR_draco_mesh_compression", "KHR_texture_basisu"};
+
+    static constexpr uint32_t Glb_Chunk_Json = 0x4E4F534A;
+    static constexpr uint32_t Glb_Chunk_Bin = 0x004E4942;
+
+    static bool is_glb(std::span<const unsigned char> bytes) {
+      return bytes.size() >= 12 && std::memcmp(bytes.data(), "glTF", 4) == 0;
+    }
+
+    // GLB layout: 12 byte header, then chunks of {u32 length, u32 type, payload}.
+    // The first chunk is JSON, the optional second one is BIN.
+    static std::span<const unsigned char> find_glb_chunk(std::span<const unsigned char> bytes, uint32_t type) {
+      size_t offset = 12;
+      while(offset + 8 <= bytes.size()) {
+        uint32_t chunk_length{}, chunk_type{};
+        std::memcpy(&chunk_length, bytes.data() + offset, 4);
+        std::memcpy(&chunk_type, bytes.data() + offset + 4, 4);
+        offset += 8;
+
+        if(offset + chunk_length > bytes.size()) break;
+        if(chunk_type == type) return bytes.subspan(offset, chunk_length);
+
+        // Chunks are padded to 4 bytes.
+        offset += (chunk_length + 3) & ~size_t(3);
+      }
+      return {};
+    }
+
+  protected:
+
+    // The .gltf/.glb itself and the files that buffers and images point into. Only kept alive while loading.
+    // File_System callbacks hand over mappings from any thread, hence the mutex.
+    Mapped_File source_file{};
+    std::span<const unsigned char> glb_bin_chunk{};
+    std::vector<std::unique_ptr<Mapped_File>> mapped_files{};
+    std::mutex mapped_files_mutex;
+    // Encoded bytes of images with an external or a data: uri.
+    std::vector<File_Contents> image_files{};
+    std::filesystem::path base_dir{};
+
+    // Set by any load task that hits bad data, the load still runs to completion.
+    std::atomic<bool> load_failed = false;
+    std::vector<double> image_decode_milliseconds{};
+    // Which textures sample each image.
+    std::vector<std::vector<int>> image_textures{};
+
+    // Per image, the image with the same encoded bytes that is decoded instead, or -1. Claimed by
+    // whichever decode task gets there first. By digest, the images whose bytes are then compared.
+    std::vector<int> image_originals{};
+    std::map<Content_Hash, std::vector<int>> image_contents{};
+    std::mutex image_contents_mutex;
+    std::atomic<int> duplicate_images{};
+    std::atomic<size_t> duplicate_image_bytes{};
+
+    // Per mesh and primitive, the bufferView its repacked vertices go to. Empty unless repack.enabled.
+    std::vector<std::vector<Buffer_View_Handle>> repacked_buffer_views{};
+    // Per mesh and primitive, the bufferView the geometry optimizer writes its indices to, and their
+    // type once it did. Empty unless repack.optimize.
+    std::vector<std::vector<Buffer_View_Handle>> optimized_index_buffer_views{};
+    std::vector<std::vector<Component_Type>> optimized_index_types{};
+
+    // Per mesh, summed over its optimized streams.
+    struct Optimize_Stats {
+      Vertex_Cache_Stats before{};
+      Vertex_Cache_Stats after{};
+    };
+    std::vector<Optimize_Stats> optimize_stats{};
+
+    struct Repack_Stats {
+      std::atomic<size_t> streams{};
+      std::atomic<size_t> vertices{};
+      // Bytes a vertex fetch touches, summed over the vertices: every distinct bufferView stride before, the packed stride after.
+      std::atomic<size_t> source_bytes{};
+      std::atomic<size_t> packed_bytes{};
+    };
+    Repack_Stats repack_stats{};
+
+    // A KHR_draco_mesh_compression primitive and the buffer it decodes into.
+    struct Draco_Primitive {
+      int mesh{};
+      int primitive{};
+      int buffer{};
+    };
+    std::vector<Draco_Primitive> draco_primitives{};
+
+    // Summed over the decode tasks of one codec, to compare what each costs on the same content.
+    struct Decode_Stats {
+      std::atomic<size_t> count{};
+      std::atomic<size_t> compressed_bytes{};
+      std::atomic<size_t> decoded_bytes{};
+      std::atomic<double> milliseconds{};
+
+      void add(size_t compressed, size_t decoded, std::chrono::steady_clock::time_point start) {
+        ++count;
+        compressed_bytes += compressed;
+        decoded_bytes += decoded;
+        milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      }
+    };
+    Decode_Stats meshopt_stats{};
+    Decode_Stats draco_stats{};
+    Decode_Stats basisu_stats{};
+    Decode_Stats encode_stats{};
+    std::atomic<size_t> texture_cache_hits{};
+
+    static bool is_data_uri(const std::string& uri) {
+      return uri.starts_with("data:");
+    }
+
+    // "%20" -> " ", URIs in glTF are percent-encoded.
+    static std::string decode_uri(const std::string& uri) {
+      std::string decoded;
+      decoded.reserve(uri.size());
+      for(size_t i = 0; i < uri.size(); ++i) {
+        if(uri[i] == '%' && i + 2 < uri.size()) {
+          int value{};
+          auto result = std::from_chars(uri.data() + i + 1, uri.data() + i + 3, value, 16);
+          if(result.ec == std::errc() && result.ptr == uri.data() + i + 3) {
+            decoded += char(value);
+            i += 2;
+            continue;
+          }
+        }
+        decoded += uri[i];
+      }
+      return decoded;
+    }
+
+    // Decodes straight into owned, from the JSON text when the parser left the payload there.
+    static bool decode_data_uri(const std::string& uri, std::string_view embedded, std::vector<unsigned char>& owned) {
+      auto comma = uri.find(',');
+      if(comma == std::string::npos || uri.rfind(";base64", comma) == std::string::npos) {
+        std::cout << "Only base64 data URIs are supported." << std::endl;
+        return false;
+      }
+      if(embedded.empty()) embedded = std::string_view(uri).substr(comma + 1);
+      if(!base64_decode(embedded, owned)) {
+        std::cout << "Invalid base64 data URI." << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    bool is_external(const std::string& uri) const {
+      return !uri.empty() && !is_data_uri(uri);
+    }
+
+    std::string external_path(const std::string& uri) const {
+      return (base_dir / decode_uri(uri)).string();
+    }
+
+    // Keeps whatever holds the bytes alive until release_sources().
+    std::span<const unsigned char> keep_contents(File_Contents& contents, std::vector<unsigned char>& owned) {
+      if(contents.mapping) {
+        std::lock_guard lock(mapped_files_mutex);
+        mapped_files.push_back(std::move(contents.mapping));
+      } else {
+        owned = std::move(contents.owned);
+      }
+      return contents.bytes;
+    }
+
+    // Checks bufferViews against the byteLength each buffer declares, before any bytes are read.
+    bool validate_buffer_views() const {
+      for(int buffer_view_index = 0; buffer_view_index < buffer_views.size(); ++buffer_view_index) {
+        const auto& buffer_view = buffer_views[buffer_view_index];
+        if(buffer_view.buffer < 0 || buffer_view.buffer >= buffers.size() ||
+           buffer_view.byte_offset + buffer_view.byte_length > buffers[buffer_view.buffer].byte_length) {
+          std::cout << "BufferView " << buffer_view_index << " is out of range." << std::endl;
+          return false;
+        }
+        if(!valid_compression(buffer_view)) {
+          std::cout << "BufferView " << buffer_view_index << " has invalid EXT_meshopt_compression properties." << std::endl;
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool valid_compression(const Buffer_View& buffer_view) const {
+      const auto& compression = buffer_view.compression;
+      if(compression.mode == Meshopt_Mode::None) return true;
+      if(compression.buffer < 0 || compression.buffer >= buffers.size() || buffers[compression.buffer].decoded ||
+         compression.byte_offset + compression.byte_length > buffers[compression.buffer].byte_length) {
+        return false;
+      }
+      if(compression.count < 0 || size_t(compression.count) * compression.byte_stride > buffer_view.byte_length) return false;
+
+      if(compression.mode == Meshopt_Mode::Attributes) return compression.byte_stride > 0 && compression.byte_stride <= 256 && compression.byte_stride % 4 == 0;
+      if(compression.byte_stride != 2 && compression.byte_stride != 4) return false;
+      return compression.mode != Meshopt_Mode::Triangles || compression.count % 3 == 0;
+    }
+
+    // Runs on a worker thread, for buffers in the BIN chunk or in a data: URI. A buffer that can't
+    // be read is left empty, which every later stage treats as missing data.
+    void load_buffer_source(int buffer_index) {
+      auto& buffer = buffers[buffer_index];
+
+      if(buffer.uri.empty()) {
+        // Only the first buffer of a .glb may leave out the uri, it lives in the BIN chunk.
+        if(buffer_index != 0 || glb_bin_chunk.empty()) {
+          std::cout << "Buffer " << buffer_index << " has no uri." << std::endl;
+          load_failed = true;
+          return;
+        }
+        buffer.bytes = glb_bin_chunk;
+      } else if(decode_data_uri(buffer.uri, buffer.embedded, buffer.owned)) {
+        buffer.bytes = buffer.owned;
+      } else {
+        load_failed = true;
+        return;
+      }
+
+      check_buffer_length(buffer_index);
+    }
+
+    // Called by the File_System, on whatever thread it completes reads on.
+    void receive_buffer_file(int buffer_index, File_Contents contents) {
+      auto& buffer = buffers[buffer_index];
+      if(!contents.ok) {
+        std::cout << "Failed to read: " << buffer.uri << std::endl;
+        load_failed = true;
+        return;
+      }
+      buffer.bytes = keep_contents(contents, buffer.owned);
+      check_buffer_length(buffer_index);
+    }
+
+    void check_buffer_length(int buffer_index) {
+      auto& buffer = buffers[buffer_index];
+      if(buffer.bytes.size() < buffer.byte_length) {
+        std::cout << "Buffer " << buffer_index << " is shorter than its byteLength." << std::endl;
+        buffer.bytes = {};
+        load_failed = true;
+      }
+    }
+
+    // Runs on a worker thread, once per EXT_meshopt_compression bufferView, after its compressed
+    // buffer is in. Writes only its own range of the decoded buffer.
+    void decode_buffer_view(int buffer_view_index) {
+      auto start = std::chrono::steady_clock::now();
+      const auto& buffer_view = buffer_views[buffer_view_index];
+      const auto& compression = buffer_view.compression;
+      const auto source = buffers[compression.buffer].bytes;
+      // The failed read was already reported.
+      if(source.empty()) return;
+
+      const auto encoded = source.subspan(compression.byte_offset, compression.byte_length);
+      unsigned char* destination = buffers[buffer_view.buffer].owned.data() + buffer_view.byte_offset;
+      const size_t count = size_t(compression.count);
+      const size_t stride = size_t(compression.byte_stride);
+
+      bool ok = false;
+      switch (compression.mode) {
+        case Meshopt_Mode::Attributes: {
+          ok = meshopt_decode_vertex_buffer(destination, count, stride, encoded) && meshopt_decode_filter(compression.filter, destination, count, stride);
+          break;
+        }
+        case Meshopt_Mode::Triangles: { ok = meshopt_decode_index_buffer(destination, count, stride, encoded);   break; }
+        case Meshopt_Mode::Indices:   { ok = meshopt_decode_index_sequence(destination, count, stride, encoded); break; }
+        case Meshopt_Mode::None:      break;
+      }
+      if(!ok) {
+        std::cout << "Failed to decode bufferView " << buffer_view_index << ": corrupt EXT_meshopt_compression data." << std::endl;
+        load_failed = true;
+      }
+      meshopt_stats.add(encoded.size(), buffer_view.byte_length, start);
+    }
+
+    // Runs on a worker thread, once per KHR_draco_mesh_compression primitive, after the buffer with
+    // its compressed data is in. Writes the accessors add_draco_buffer_views() gave it, nothing else.
+    void decode_draco_primitive(int draco_index) {
+      auto start = std::chrono::steady_clock::now();
+      const auto& [mesh_index, primitive_index, buffer_index] = draco_primitives[draco_index];
+      const auto& primitive = meshes[mesh_index].primitives[primitive_index];
+      const auto encoded = buffer_view_data(primitive.draco_buffer_view);
+      // The failed read was already reported.
+      if(encoded.empty()) return;
+
+      auto output = [&](Accessor_Handle accessor_handle, int unique_id) {
+        Draco_Output output;
+        output.unique_id = unique_id;
+        if(accessor_handle == Invalid_Accessor_Handle) return output;
+        const auto& accessor = accessors[accessor_handle];
+        const auto& buffer_view = buffer_views[accessor.buffer_view];
+        if(buffer_view.buffer != buffer_index) return output;
+        output.destination = buffers[buffer_index].owned.data() + buffer_view.byte_offset;
+        output.component_type = accessor.component_type;
+        output.components = component_count(accessor.type);
+        output.count = size_t(accessor.count);
+        output.stride = buffer_view.byte_stride != 0 ? size_t(buffer_view.byte_stride) : size_t(accessor.element_size());
+        return output;
+      };
+      std::array<Draco_Output, Attribute_Count> attributes;
+      for(int slot = 0; slot < Attribute_Count; ++slot) attributes[slot] = output(primitive.attributes[slot], primitive.draco_attributes[slot]);
+
+      std::string error;
+      if(!draco_decode_mesh(encoded, attributes, output(primitive.indices, -1), error)) {
+        std::cout << "Failed to decode Draco primitive " << primitive_index << " of mesh " << mesh_index << ": " << error << std::endl;
+        load_failed = true;
+      }
+      draco_stats.add(encoded.size(), buffers[buffer_index].byte_length, start);
+    }
+
+    // Runs on a worker thread. Only touches its own Image.
+    void decode_image(int image_index) {
+      auto start = std::chrono::steady_clock::now();
+      auto& image = images[image_index];
+
+      auto& file = image_files[image_index];
+      bool resolved = true;
+      if(image.buffer_view == Invalid_Buffer_View_Handle && is_external(image.uri)) {
+        resolved = file.ok;
+        if(!resolved) std::cout << "Failed to read: " << image.uri << std::endl;
+      } else if(image.buffer_view == Invalid_Buffer_View_Handle) {
+        // Kept until the load is done, later duplicates compare their bytes against it.
+        resolved = file.ok = decode_data_uri(image.uri, image.embedded, file.owned);
+        file.bytes = file.owned;
+      }
+      const std::span<const unsigned char> encoded = encoded_image(image_index);
+      // Keys both the duplicate search and the texture cache.
+      const Content_Hash hash = resolved ? content_hash(encoded) : Content_Hash{};
+
+      if(resolved && claim_image_contents(image_index, encoded, hash)) {
+        if(is_ktx2(encoded)) {
+          std::string error;
+          if(!ktx2_transcode(encoded, texture_compression, image, error)) {
+            std::cout << "Failed to transcode KTX2 image " << image_index << ": " << error << std::endl;
+          }
+          basisu_stats.add(encoded.size(), image.pixels.size(), start);
+        } else if(encoding_textures() && read_encoded_image(image_index, encoded, hash)) {
+          ++texture_cache_hits;
+        } else {
+          // Grey and grey with alpha stay one and two channels, the GL side swizzles them. RGB becomes
+          // RGBA, GPUs have no three channel formats worth sampling from.
+          int width{}, height{}, component{};
+          stbi_info_from_memory(encoded.data(), int(encoded.size()), &width, &height, &component);
+          const int channels = component == 1 || component == 2 ? component : 4;
+          void* pixels;
+          if(stbi_is_16_bit_from_memory(encoded.data(), int(encoded.size()))) {
+            pixels = stbi_load_16_from_memory(encoded.data(), int(encoded.size()), &width, &height, &component, channels);
+            image.bits = 16;
+          } else {
+            pixels = stbi_load_from_memory(encoded.data(), int(encoded.size()), &width, &height, &component, channels);
+            image.bits = 8;
+          }
+
+          if(pixels == nullptr) {
+            std::cout << "Failed to decode image " << image_index << ": " << stbi_failure_reason() << std::endl;
+          } else {
+            image.width = width;
+            image.height = height;
+            image.component = channels;
+            auto* first = static_cast<const unsigned char*>(pixels);
+            image.pixels.assign(first, first + size_t(width) * height * channels * (image.bits / 8));
+            stbi_image_free(pixels);
+            if(encoding_textures()) encode_image(image_index, encoded, hash);
+          }
+        }
+      }
+
+      image_decode_milliseconds[image_index] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool encoding_textures() const {
+      return texture_encode.enabled && texture_compression != Texture_Compression::None;
+    }
+
+    bool encoding_bc7() const {
+      return texture_encode.bc7 && texture_compression == Texture_Compression::Bc7;
+    }
+
+    // The settings that change what encode_image() writes are part of the name, the rest of the key
+    // is checked against the file's header.
+    std::string texture_cache_path(const Content_Hash& source_hash) const {
+      char name[64];
+      std::snprintf(name, sizeof(name), "%016llx%016llx-%s.bcn", static_cast<unsigned long long>(source_hash.high),
+                    static_cast<unsigned long long>(source_hash.low), encoding_bc7() ? "bc7" : "bc1");
+      return (std::filesystem::path(texture_encode.cache_directory) / name).string();
+    }
+
+    // Runs on a worker thread, in place of decoding.
+    bool read_encoded_image(int image_index, std::span<const unsigned char> encoded, const Content_Hash& source_hash) {
+      if(texture_encode.cache_directory.empty()) return false;
+      return read_texture_cache(texture_cache_path(source_hash), source_hash, encoded.size(), images[image_index]);
+    }
+
+    // Runs on a worker thread, right after decoding. Images encode in parallel, one per worker.
+    void encode_image(int image_index, std::span<const unsigned char> encoded, const Content_Hash& source_hash) {
+      auto start = std::chrono::steady_clock::now();
+      auto& image = images[image_index];
+      const size_t decoded_bytes = image.pixels.size();
+      encode_texture(image, encoded_format(image, encoding_bc7()));
+      encode_stats.add(decoded_bytes, image.pixels.size(), start);
+
+      if(texture_encode.cache_directory.empty()) return;
+      if(!write_texture_cache(texture_cache_path(source_hash), source_hash, encoded.size(), image)) {
+        std::cout << "Failed to write the encoded image " << image_index << " to the texture cache " << texture_encode.cache_directory << std::endl;
+      }
+    }
+
+    // An image's bytes as they are in the file, once its decode task resolved them.
+    std::span<const unsigned char> encoded_image(int image_index) const {
+      if(images[image_index].buffer_view != Invalid_Buffer_View_Handle) return buffer_view_data(images[image_index].buffer_view);
+      return image_files[image_index].bytes;
+    }
+
+    // False when another image already has these encoded bytes, which makes this one its duplicate.
+    bool claim_image_contents(int image_index, std::span<const unsigned char> encoded, const Content_Hash& hash) {
+      std::lock_guard lock(image_contents_mutex);
+      auto& candidates = image_contents[hash];
+      for(int candidate : candidates) {
+        if(!std::ranges::equal(encoded_image(candidate), encoded)) continue;
+        image_originals[image_index] = candidate;
+        ++duplicate_images;
+        duplicate_image_bytes += encoded.size();
+        return false;
+      }
+      candidates.push_back(image_index);
+      return true;
+    }
+
+    // Runs on a worker thread, once per glTF mesh. Primitives that read the same bufferViews with the
+    // same attribute formats end up with the same layout, and draw their own range with base_vertex.
+    void prepare_mesh(int mesh_index) {
+      auto& mesh = meshes[mesh_index];
+      auto& prepared = prepared_meshes[mesh_index];
+
+      load_bounds(mesh);
+      prepared.reserve(mesh.primitives.size());
+      // Streams already written, primitives can share one.
+      std::vector<Buffer_View_Handle> repacked_streams;
+
+      for(int primitive_index = 0; primitive_index < mesh.primitives.size(); ++primitive_index) {
+        const auto& primitive = mesh.primitives[primitive_index];
+
+        if(!indices_in_range(primitive)) {
+          std::cout << "Skipping primitive " << primitive_index << " of mesh " << mesh_index << ": indices are out of range." << std::endl;
+          continue;
+        }
+
+        Vertex_Layout layout;
+        int base_vertex = -1;
+        bool shared_base_vertex = true;
+        auto accessor_draw_count = 0;
+
+        // A repacked stream starts at its own first vertex.
+        bool quantized = false;
+        const bool repacked = repack_primitive(mesh_index, primitive_index, repacked_streams, layout, accessor_draw_count, quantized);
+        if(repacked) base_vertex = 0;
+
+        for (int slot = 0; slot < Attribute_Count && !repacked; ++slot) {
+          if (primitive.attributes[slot] == Invalid_Accessor_Handle) {
+            continue;
+          }
+
+          auto& accessor = accessors[primitive.attributes[slot]];
+          if (accessor.buffer_view == Invalid_Buffer_View_Handle) {
+            continue;
+          }
+          int byte_stride = buffer_views[accessor.buffer_view].byte_stride;
+          if (byte_stride == 0) byte_stride = accessor.element_size();
+          if (byte_stride <= 0) {
+            continue;
+          }
+
+          auto& attribute = layout.attributes[slot];
+          attribute.buffer_view = accessor.buffer_view;
+          attribute.component_type = accessor.component_type;
+          attribute.components = component_count(accessor.type);
+          attribute.normalized = accessor.normalized;
+          attribute.byte_stride = byte_stride;
+          attribute.byte_offset = accessor.byte_offset;
+
+          // Every attribute has to start the same number of vertices into its bufferView,
+          // otherwise one base vertex can't address all of them.
+          int attribute_base_vertex = accessor.byte_offset / byte_stride;
+          if(base_vertex == -1) base_vertex = attribute_base_vertex;
+          if(base_vertex != attribute_base_vertex) shared_base_vertex = false;
+
+          accessor_draw_count = accessor.count;
+        }
+
+        if(base_vertex == -1 || !shared_base_vertex) {
+          base_vertex = 0;
+        } else {
+          for(auto& attribute : layout.attributes) {
+            if(attribute.buffer_view != Invalid_Buffer_View_Handle) attribute.byte_offset -= base_vertex * attribute.byte_stride;
+          }
+        }
+
+        Vertex_Array vao;
+        vao.base_vertex = base_vertex;
+        vao.primitive_mode = primitive.mode;
+
+        if(repacked && !optimized_index_types.empty() && optimized_index_types[mesh_index][primitive_index] != Component_Type{}) {
+          vao.has_indices = true;
+          layout.indices_buffer_view = optimized_index_buffer_views[mesh_index][primitive_index];
+          vao.indices_component_type = optimized_index_types[mesh_index][primitive_index];
+          vao.count = optimizable_index_count(primitive);
+          vao.offset = 0;
+        } else if(primitive.indices <= -1) {
+          vao.has_indices = false;
+          // When we are not working with indexed geometry, then use the accessor count which should be the same for each attribute's accessor.
+          vao.count = accessor_draw_count;
+        } else {
+          vao.has_indices = true;
+          auto& indices_accessor = accessors[primitive.indices];
+          layout.indices_buffer_view = indices_accessor.buffer_view;
+          vao.indices_component_type = static_cast<Component_Type>(indices_accessor.component_type);
+          vao.count = indices_accessor.count;
+          vao.offset = indices_accessor.byte_offset;
+        }
+
+        prepared.push_back({layout, vao, primitive.material, quantized, streaming.enabled ? texcoord_density(primitive) : 0.0f});
+      }
+    }
+
+    // Runs on a worker thread, once per animation.
+    void load_animation(int animation_index) {
+      auto& animation = animations[animation_index];
+
+      for(int channel_index = 0; channel_index < animation.channels.size(); ++channel_index) {
+        auto& channel = animation.channels[channel_index];
+        auto& gltf_sampler = animation.samplers[channel.sampler];
+
+        channel.interpolation = gltf_sampler.interpolation;
+
+        const Accessor_View<float> time_steps(*this, gltf_sampler.input);
+        const Accessor_View<glm::vec3> translations(*this, gltf_sampler.output);
+        const Accessor_View<glm::quat> rotations(*this, gltf_sampler.output);
+
+        if(time_steps.empty()) {
+          std::cout << "Animation channel " << channel_index << " has no keyframes." << std::endl;
+          continue;
+        }
+
+        channel.frames.reserve(time_steps.size());
+        for (int i = 0; i < time_steps.size(); ++i) {
+          Frame frame;
+
+          frame.time = time_steps[i];
+
+          if(channel.target_path == gltf::Target_Path::Translation) {
+            if(i < translations.size()) frame.translation = translations[i];
+          } else if(channel.target_path == gltf::Target_Path::Rotation) {
+            if(i < rotations.size()) frame.rotation = rotations[i];
+          } else if(channel.target_path == gltf::Target_Path::Scale) {
+            std::cout << "FIXME: Implement Scaling Animations." << std::endl;
+          } else if(channel.target_path == gltf::Target_Path::Weights) {
+            std::cout << "FIXME: Implement Weight Animations." << std::endl;
+          }
+
+          channel.frames.push_back(frame);
+        }
+
+        animation.total_animation_duration = std::max(animation.total_animation_duration, time_steps[time_steps.size() - 1]);
+        channel.start_time = channel.frames.front().time;
+        channel.end_time = channel.frames.back().time;
+      }
+    }
+
+    void load_bounds(Mesh& mesh) {
+      bool first = true;
+      for(auto& primitive : mesh.primitives) {
+        if(primitive.attributes[Position] == Invalid_Accessor_Handle) continue;
+        const auto& accessor = accessors[primitive.attributes[Position]];
+
+        // POSITION is required to have min and max, only scan when an exporter left them out.
+        if(accessor.has_bounds) {
+          primitive.min = glm::vec3(float(accessor.min[0]), float(accessor.min[1]), float(accessor.min[2]));
+          primitive.max = glm::vec3(float(accessor.max[0]), float(accessor.max[1]), float(accessor.max[2]));
+        } else {
+          const Accessor_View<glm::vec3> positions(*this, primitive.attributes[Position]);
+          if(positions.empty()) continue;
+          primitive.min = primitive.max = positions[0];
+          for(auto position : positions) {
+            primitive.min = glm::min(primitive.min, position);
+            primitive.max = glm::max(primitive.max, position);
+          }
+        }
+
+        mesh.min = first ? primitive.min : glm::min(mesh.min, primitive.min);
+        mesh.max = first ? primitive.max : glm::max(mesh.max, primitive.max);
+        first = false;
+      }
+    }
+
+    // sqrt of the TEXCOORD_0 area over the POSITION area of a triangle list. How many texels a
+    // texture puts on one object space unit is then this times the texture's size.
+    float texcoord_density(const Primitive& primitive) const {
+      if(primitive.mode != Primitive_Mode::Triangles || primitive.material < 0 || primitive.material >= materials.size() ||
+         materials[primitive.material].base_texture < 0) return 0.0f;
+
+      const Accessor_View<glm::vec3> positions(*this, primitive.attributes[Position]);
+      const Accessor_View<glm::vec2> texcoords(*this, primitive.attributes[Texcoord_0]);
+      const Accessor_View<uint32_t> indices(*this, primitive.indices);
+      if(positions.empty() || texcoords.size() != positions.size()) return 0.0f;
+
+      const size_t count = primitive.indices == Invalid_Accessor_Handle ? positions.size() : indices.size();
+      double position_area = 0.0, texcoord_area = 0.0;
+      for(size_t corner = 0; corner + 2 < count; corner += 3) {
+        uint32_t triangle[3];
+        for(int i = 0; i < 3; ++i) triangle[i] = primitive.indices == Invalid_Accessor_Handle ? uint32_t(corner + i) : indices[corner + i];
+        // Out of range indices are dropped with their primitive, see indices_in_range().
+        if(std::max({triangle[0], triangle[1], triangle[2]}) >= positions.size()) return 0.0f;
+
+        const glm::vec3 a = positions[triangle[0]], b = positions[triangle[1]], c = positions[triangle[2]];
+        const glm::vec2 u = texcoords[triangle[0]], v = texcoords[triangle[1]], w = texcoords[triangle[2]];
+        position_area += glm::length(glm::cross(b - a, c - a));
+        texcoord_area += std::abs((v.x - u.x) * (w.y - u.y) - (w.x - u.x) * (v.y - u.y));
+      }
+      return position_area > 0.0 ? float(std::sqrt(texcoord_area / position_area)) : 0.0f;
+    }
+
+    // Out of range indices make the GPU read past the vertex buffers. Drop those primitives.
+    bool indices_in_range(const Primitive& primitive) const {
+      if(primitive.indices == Invalid_Accessor_Handle || primitive.attributes[Position] == Invalid_Accessor_Handle) return true;
+
+      const Accessor_View<uint32_t> indices(*this, primitive.indices);
+      if(indices.empty() && accessors[primitive.indices].count > 0) return false;
+
+      const uint32_t vertex_count = uint32_t(accessors[primitive.attributes[Position]].count);
+      uint32_t max_index = 0;
+      if(auto packed = indices.as_span(); !packed.empty()) {
+        max_index = *std::max_element(packed.begin(), packed.end());
+      } else {
+        for(uint32_t index : indices) max_index = std::max(max_index, index);
+      }
+      return indices.empty() || max_index < vertex_count;
+    }
+
+    // The buffer an accessor reads from, or -1.
+    int accessor_buffer(Accessor_Handle accessor_handle) const {
+      if(accessor_handle < 0 || accessor_handle >= accessors.size()) return -1;
+      int buffer_view = accessors[accessor_handle].buffer_view;
+      if(buffer_view < 0 || buffer_view >= buffer_views.size()) return -1;
+      return buffer_views[buffer_view].buffer;
+    }
+
+    // Buffer reads, image decodes, mesh preparation and animation extraction run on the worker pool.
+    // The optional upload steps run on the calling thread, which owns the GL context. Each task only
+    // waits for the buffers it actually reads, so the first meshes and textures upload while later
+    // files are still being read and decoded.
+    void run_load_graph(const std::function<void(int)>& upload_image, const std::function<void(int)>& upload_mesh) {
+      using Affinity = Task_Graph::Affinity;
+      Task_Graph graph;
+
+      image_decode_milliseconds.assign(images.size(), 0.0);
+      image_originals.assign(images.size(), -1);
+      image_contents.clear();
+      duplicate_images = 0;
+      duplicate_image_bytes = 0;
+      prepared_meshes.resize(meshes.size());
+
+      // Every external file is requested up front in one batch. Each read completes its own task from
+      // whichever thread the File_System calls back on, which releases the decodes and uploads waiting on it.
+      std::vector<File_Read> reads;
+      image_files.clear();
+      image_files.resize(images.size());
+
+      std::vector<Task_Graph::Task_Id> buffer_tasks(buffers.size());
+      for(int buffer_index = 0; buffer_index < buffers.size(); ++buffer_index) {
+        // Written by prepare_mesh() or the decodes below, nothing to read.
+        if(buffers[buffer_index].repacked || buffers[buffer_index].decoded) continue;
+
+        const auto& uri = buffers[buffer_index].uri;
+        if(is_external(uri)) {
+          auto task = graph.add_external("read buffer " + std::to_string(buffer_index));
+          reads.push_back({external_path(uri), [this, &graph, task, buffer_index](File_Contents contents) {
+            receive_buffer_file(buffer_index, std::move(contents));
+            graph.complete(task);
+          }});
+          buffer_tasks[buffer_index] = task;
+        } else {
+          buffer_tasks[buffer_index] = graph.add("load buffer " + std::to_string(buffer_index), Affinity::Worker,
+                                                 [this, buffer_index] { load_buffer_source(buffer_index); });
+        }
+      }
+
+      // Compressed bufferViews decode in parallel, each as soon as its compressed buffer is in, straight
+      // into the buffer the GL side uploads from. Whatever reads a decoded buffer waits for all its views.
+      std::vector<std::vector<Task_Graph::Task_Id>> decodes(buffers.size());
+      for(int buffer_view_index = 0; buffer_view_index < buffer_views.size(); ++buffer_view_index) {
+        const auto& buffer_view = buffer_views[buffer_view_index];
+        if(buffer_view.compression.mode == Meshopt_Mode::None) continue;
+        decodes[buffer_view.buffer].push_back(graph.add("decode bufferView " + std::to_string(buffer_view_index), Affinity::Worker,
+                                                        [this, buffer_view_index] { decode_buffer_view(buffer_view_index); },
+                                                        {buffer_tasks[buffer_view.compression.buffer]}));
+      }
+      // Draco primitives the same way, one task each.
+      for(int draco_index = 0; draco_index < draco_primitives.size(); ++draco_index) {
+        const auto& [mesh_index, primitive_index, buffer_index] = draco_primitives[draco_index];
+        const auto& primitive = meshes[mesh_index].primitives[primitive_index];
+        decodes[buffer_index].push_back(graph.add("decode Draco primitive " + std::to_string(primitive_index) + " of mesh " + std::to_string(mesh_index),
+                                                  Affinity::Worker, [this, draco_index] { decode_draco_primitive(draco_index); },
+                                                  {buffer_tasks[buffer_views[primitive.draco_buffer_view].buffer]}));
+      }
+      for(int buffer_index = 0; buffer_index < buffers.size(); ++buffer_index) {
+        auto& buffer = buffers[buffer_index];
+        if(!buffer.decoded) continue;
+        buffer.owned.assign(buffer.byte_length, 0);
+        buffer.bytes = buffer.owned;
+        buffer_tasks[buffer_index] = graph.add("decoded buffer " + std::to_string(buffer_index), Affinity::Worker, {}, decodes[buffer_index]);
+      }
+
+      auto depend_on_buffer = [&](Accessor_Handle accessor_handle, std::vector<Task_Graph::Task_Id>& dependencies) {
+        int buffer = accessor_buffer(accessor_handle);
+        if(buffer < 0) return;
+        if(std::find(dependencies.begin(), dependencies.end(), buffer_tasks[buffer]) == dependencies.end()) dependencies.push_back(buffer_tasks[buffer]);
+      };
+
+      image_textures.assign(images.size(), {});
+      for(int texture_index = 0; texture_index < textures.size(); ++texture_index) {
+        int source = textures[texture_index].source;
+        if(source >= 0 && source < images.size()) image_textures[source].push_back(texture_index);
+      }
+
+      for(int image_index = 0; image_index < images.size(); ++image_index) {
+        // Such as the PNG fallback of a KHR_texture_basisu texture.
+        if(image_textures[image_index].empty()) continue;
+        std::vector<Task_Graph::Task_Id> dependencies;
+        if(int buffer_view = images[image_index].buffer_view; buffer_view >= 0 && buffer_view < buffer_views.size()) {
+          dependencies.push_back(buffer_tasks[buffer_views[buffer_view].buffer]);
+        } else if(is_external(images[image_index].uri)) {
+          auto task = graph.add_external("read image " + std::to_string(image_index));
+          reads.push_back({external_path(images[image_index].uri), [this, &graph, task, image_index](File_Contents contents) {
+            image_files[image_index] = std::move(contents);
+            graph.complete(task);
+          }});
+          dependencies.push_back(task);
+        }
+        auto decode = graph.add("decode image " + std::to_string(image_index), Affinity::Worker,
+                                [this, image_index] { decode_image(image_index); }, dependencies);
+        if(upload_image) {
+          graph.add("upload image " + std::to_string(image_index), Affinity::Main, [&upload_image, image_index] { upload_image(image_index); }, {decode});
+        }
+      }
+
+      for(int mesh_index = 0; mesh_index < meshes.size(); ++mesh_index) {
+        std::vector<Task_Graph::Task_Id> dependencies;
+        for(const auto& primitive : meshes[mesh_index].primitives) {
+          for(auto attribute : primitive.attributes) depend_on_buffer(attribute, dependencies);
+          depend_on_buffer(primitive.indices, dependencies);
+        }
+        auto prepare = graph.add("prepare mesh " + std::to_string(mesh_index), Affinity::Worker,
+                                 [this, mesh_index] { prepare_mesh(mesh_index); }, dependencies);
+        if(upload_mesh) {
+          graph.add("upload mesh " + std::to_string(mesh_index), Affinity::Main, [&upload_mesh, mesh_index] { upload_mesh(mesh_index); }, {prepare});
+        }
+      }
+
+      for(int animation_index = 0; animation_index < animations.size(); ++animation_index) {
+        std::vector<Task_Graph::Task_Id> dependencies;
+        for(const auto& sampler : animations[animation_index].samplers) {
+          depend_on_buffer(sampler.input, dependencies);
+          depend_on_buffer(sampler.output, dependencies);
+        }
+        graph.add("load animation " + std::to_string(animation_index), Affinity::Worker,
+                  [this, animation_index] { load_animation(animation_index); }, dependencies);
+      }
+
+      if(!reads.empty()) {
+        graph.add("submit reads", Affinity::Worker, [this, &reads] { file_system(std::move(reads)); });
+      }
+
+      graph.run(Thread_Pool::shared());
+      graph.print_report("glTF load");
+
+      if(repack_stats.vertices > 0) {
+        const double vertices = double(repack_stats.vertices);
+        std::cout << "Vertex repack: " << repack_stats.streams << " streams, " << repack_stats.vertices << " vertices, "
+                  << repack_stats.source_bytes / vertices << " -> " << repack_stats.packed_bytes / vertices << " bytes per vertex ("
+                  << repack_stats.source_bytes << " -> " << repack_stats.packed_bytes << " bytes)" << std::endl;
+      }
+
+      if(duplicate_images > 0) {
+        std::cout << "Image dedup: " << duplicate_images << " images repeat the encoded bytes of another, "
+                  << duplicate_image_bytes / 1024.0 << " KiB not decoded" << std::endl;
+      }
+
+      for(const auto& [name, stats] : {std::pair<const char*, const Decode_Stats&>{"EXT_meshopt_compression", meshopt_stats}, {"KHR_draco_mesh_compression", draco_stats},
+                                        {"KHR_texture_basisu", basisu_stats}}) {
+        if(stats.count == 0) continue;
+        std::cout << name << ": " << stats.count << " decodes, " << stats.compressed_bytes / 1024.0 << " -> " << stats.decoded_bytes / 1024.0 << " KiB, "
+                  << stats.milliseconds << " ms of decode work" << std::endl;
+      }
+      if(encode_stats.count > 0 || texture_cache_hits > 0) {
+        std::cout << "BCn encode: " << encode_stats.count << " images, " << encode_stats.compressed_bytes / 1024.0 << " -> " << encode_stats.decoded_bytes / 1024.0
+                  << " KiB, " << encode_stats.milliseconds << " ms of encode work, " << texture_cache_hits << " images read from the texture cache" << std::endl;
+      }
+
+      for(int mesh_index = 0; mesh_index < optimize_stats.size(); ++mesh_index) {
+        const auto& [before, after] = optimize_stats[mesh_index];
+        if(before.triangles == 0) continue;
+        std::cout << "Geometry optimizer, mesh " << mesh_index << " '" << meshes[mesh_index].name << "': ACMR " << before.acmr() << " -> " << after.acmr()
+                  << ", ATVR " << before.atvr() << " -> " << after.atvr() << ", " << before.vertices << " -> " << after.vertices << " vertices" << std::endl;
+      }
+    }
+
+    // Everything below only points into the load-time sources, drop it once it has been uploaded or
+    // written out. What the retention policy keeps is copied out of the mappings first.
+    void release_sources() {
+      if(retention == Retention::Geometry) retain_geometry();
+      for(auto& buffer : buffers) {
+        buffer.embedded = {};
+        if(retention == Retention::Full && !buffer.bytes.empty()) {
+          if(buffer.bytes.data() != buffer.owned.data()) buffer.owned.assign(buffer.bytes.begin(), buffer.bytes.end());
+          buffer.bytes = buffer.owned;
+        } else if(retention != Retention::Geometry) {
+          buffer.bytes = {};
+          std::vector<unsigned char>().swap(buffer.owned);
+        }
+      }
+      for(auto& image : images) {
+        image.embedded = {};
+        if(retention != Retention::Full && !image.streamed) std::vector<unsigned char>().swap(image.pixels);
+      }
+      mapped_files.clear();
+      image_files.clear();
+      source_file.close();
+      glb_bin_chunk = {};
+    }
+
+    // Each buffer is replaced by a packed copy of the bufferViews the prepared meshes draw from. The
+    // other bufferViews are detached from their buffer.
+    void retain_geometry() {
+      std::vector<bool> kept(buffer_views.size());
+      for(const auto& prepared : prepared_meshes) {
+        for(const auto& primitive : prepared) {
+          for(const auto& attribute : primitive.layout.attributes) {
+            if(attribute.buffer_view != Invalid_Buffer_View_Handle) kept[attribute.buffer_view] = true;
+          }
+          if(primitive.layout.indices_buffer_view != Invalid_Buffer_View_Handle) kept[primitive.layout.indices_buffer_view] = true;
+        }
+      }
+
+      std::vector<std::vector<unsigned char>> packed(buffers.size());
+      for(int buffer_view_index = 0; buffer_view_index < buffer_views.size(); ++buffer_view_index) {
+        auto& buffer_view = buffer_views[buffer_view_index];
+        const auto bytes = buffer_view_data(buffer_view_index);
+        if(!kept[buffer_view_index] || bytes.empty()) {
+          buffer_view.buffer = -1;
+          continue;
+        }
+        auto& destination = packed[buffer_view.buffer];
+        // Keeps the 4 byte alignment GL and the accessor views expect.
+        destination.resize((destination.size() + 3) & ~size_t(3));
+        buffer_view.byte_offset = destination.size();
+        destination.insert(destination.end(), bytes.begin(), bytes.end());
+      }
+
+      for(int buffer_index = 0; buffer_index < buffers.size(); ++buffer_index) {
+        auto& buffer = buffers[buffer_index];
+        packed[buffer_index].shrink_to_fit();
+        buffer.owned = std::move(packed[buffer_index]);
+        buffer.bytes = buffer.owned;
+        buffer.byte_length = buffer.owned.size();
+      }
+    }
+
+    // Maps the file and parses its JSON. The mapping stays open for the BIN chunk of a .glb.
+    bool parse_file(const std::string& path) {
+      auto& file = source_file;
+      if(!file.open(path)) {
+        std::cout << "Failed to open glTF file: " << path << std::endl;
+        return false;
+      }
+
+      std::span<const unsigned char> json = file.bytes();
+      glb_bin_chunk = {};
+      if(is_glb(file.bytes())) {
+        json = find_glb_chunk(file.bytes(), Glb_Chunk_Json);
+        glb_bin_chunk = find_glb_chunk(file.bytes(), Glb_Chunk_Bin);
+      }
+
+      std::string error;
+      if(!Parser::parse(std::string_view(reinterpret_cast<const char*>(json.data()), json.size()), *this, error)) {
+        std::cout << "Failed to parse glTF file: " << path << "\n" << error << std::endl;
+        return false;
+      }
+
+      for(const auto& extension : extensions_required) {
+        if(std::find(std::begin(Supported_Extensions), std::end(Supported_Extensions), extension) != std::end(Supported_Extensions)) continue;
+        std::cout << "glTF file requires unsupported extension: " << extension << std::endl;
+      }
+
+      for(const auto& buffer_view : buffer_views) {
+        if(buffer_view.compression.mode != Meshopt_Mode::None && buffer_view.buffer >= 0 && buffer_view.buffer < buffers.size()) {
+          buffers[buffer_view.buffer].decoded = true;
+        }
+      }
+
+      base_dir = std::filesystem::path(path).parent_path();
+      deduplicate_materials();
+      add_draco_buffer_views();
+      if(repack.enabled) add_repacked_buffer_views();
+      return true;
+    }
+
+    // Points primitives at the first material with the same parameters. Textures count as the same
+    // when they sample the same image with the same sampler.
+    void deduplicate_materials() {
+      std::map<std::tuple<float, float, float, float, int, int>, int> firsts;
+      std::vector<int> remap(materials.size());
+      int duplicates = 0;
+      for(int material_index = 0; material_index < materials.size(); ++material_index) {
+        const auto& material = materials[material_index];
+        int source = -1, sampler = -1;
+        if(material.base_texture >= 0 && material.base_texture < textures.size()) {
+          source = textures[material.base_texture].source;
+          sampler = textures[material.base_texture].sampler;
+        }
+        const auto& color = material.base_color;
+        auto [it, inserted] = firsts.emplace(std::tuple(color.x, color.y, color.z, color.w, source, sampler), material_index);
+        remap[material_index] = it->second;
+        if(!inserted) ++duplicates;
+      }
+      if(duplicates == 0) return;
+
+      for(auto& mesh : meshes) {
+        for(auto& primitive : mesh.primitives) {
+          if(primitive.material >= 0 && primitive.material < materials.size()) primitive.material = remap[primitive.material];
+        }
+      }
+      std::cout << "Material dedup: " << duplicates << " of " << materials.size() << " materials repeat another" << std::endl;
+    }
+
+    // One new buffer per Draco primitive, with a bufferView per accessor it decodes, which the
+    // accessors are pointed at. The file's own data for them, if any, is an uncompressed fallback.
+    // Accessors shared with an earlier Draco primitive are left to that one.
+    void add_draco_buffer_views() {
+      draco_primitives.clear();
+      std::vector<bool> claimed(accessors.size());
+      for(int mesh_index = 0; mesh_index < meshes.size(); ++mesh_index) {
+        auto& primitives = meshes[mesh_index].primitives;
+        for(int primitive_index = 0; primitive_index < primitives.size(); ++primitive_index) {
+          auto& primitive = primitives[primitive_index];
+          if(primitive.draco_buffer_view == Invalid_Buffer_View_Handle) continue;
+          if(!valid_draco(primitive)) {
+            std::cout << "Primitive " << primitive_index << " of mesh " << mesh_index << " has invalid KHR_draco_mesh_compression properties." << std::endl;
+            primitive.draco_buffer_view = Invalid_Buffer_View_Handle;
+            continue;
+          }
+
+          const int buffer_index = int(buffers.size());
+          size_t buffer_length = 0;
+          auto add_view = [&](Accessor_Handle accessor_handle, int target) {
+            if(accessor_handle == Invalid_Accessor_Handle || claimed[accessor_handle]) return;
+            claimed[accessor_handle] = true;
+            auto& accessor = accessors[accessor_handle];
+            const int stride = target == GL_ARRAY_BUFFER ? (accessor.element_size() + 3) & ~3 : accessor.element_size();
+
+            Buffer_View buffer_view;
+            buffer_view.buffer = buffer_index;
+            buffer_view.byte_offset = buffer_length;
+            buffer_view.byte_length = size_t(accessor.count) * stride;
+            buffer_view.byte_stride = target == GL_ARRAY_BUFFER ? stride : 0;
+            buffer_view.target = target;
+            buffer_length += (buffer_view.byte_length + 3) & ~size_t(3);
+
+            accessor.buffer_view = Buffer_View_Handle(buffer_views.size());
+            accessor.byte_offset = 0;
+            buffer_views.push_back(buffer_view);
+          };
+          for(int slot = 0; slot < Attribute_Count; ++slot) {
+            if(primitive.draco_attributes[slot] != -1) add_view(primitive.attributes[slot], GL_ARRAY_BUFFER);
+          }
+          add_view(primitive.indices, GL_ELEMENT_ARRAY_BUFFER);
+          if(buffer_length == 0) continue;
+
+          auto& buffer = buffers.emplace_back();
+          buffer.byte_length = buffer_length;
+          buffer.decoded = true;
+          draco_primitives.push_back({mesh_index, primitive_index, buffer_index});
+        }
+      }
+    }
+
+    // Draco only encodes triangles here, and its attributes have to be ones the primitive has.
+    // The compressed data can't come from another decode, those run side by side.
+    bool valid_draco(const Primitive& primitive) const {
+      if(primitive.draco_buffer_view < 0 || primitive.draco_buffer_view >= buffer_views.size()) return false;
+      const int buffer = buffer_views[primitive.draco_buffer_view].buffer;
+      if(buffer < 0 || buffer >= buffers.size() || buffers[buffer].decoded) return false;
+      if(primitive.mode != Primitive_Mode::Triangles) return false;
+
+      auto valid_accessor = [&](Accessor_Handle accessor_handle) {
+        return accessor_handle >= 0 && accessor_handle < accessors.size() && accessors[accessor_handle].count >= 0 && accessors[accessor_handle].element_size() > 0;
+      };
+      if(primitive.indices != Invalid_Accessor_Handle && !valid_accessor(primitive.indices)) return false;
+      for(int slot = 0; slot < Attribute_Count; ++slot) {
+        if(primitive.draco_attributes[slot] != -1 && !valid_accessor(primitive.attributes[slot])) return false;
+      }
+      return true;
+    }
+
+    // A float attribute the quantizer has a smaller format for.
+    static bool quantizable(int slot, const Accessor& accessor) {
+      if(accessor.component_type != GL_FLOAT) return false;
+      return ((slot == Position || slot == Normal) && accessor.type == Accessor_Type::Vec3) || (slot == Texcoord_0 && accessor.type == Accessor_Type::Vec2);
+    }
+
+    // The repacked vertex: kept attributes have components set, offsets are 4 byte aligned for GL.
+    // Returns the stride, or 0 when the primitive has to keep its original layout.
+    int repacked_vertex_format(const Primitive& primitive, Vertex_Layout& format, bool& quantized) const {
+      format = {};
+      quantized = false;
+      if(primitive.attributes[Position] == Invalid_Accessor_Handle) return 0;
+      const int vertex_count = accessors[primitive.attributes[Position]].count;
+      if(vertex_count <= 0) return 0;
+
+      const bool skinned = repack.skinned && primitive.attributes[Joints_0] != Invalid_Accessor_Handle &&
+                           primitive.attributes[Weights_0] != Invalid_Accessor_Handle;
+      auto kept = [&](int slot) {
+        return primitive.attributes[slot] != Invalid_Accessor_Handle && (repack.attributes[slot] || (skinned && (slot == Joints_0 || slot == Weights_0)));
+      };
+
+      // All or nothing, so that a quantized primitive always means dequantized positions and octahedral normals.
+      quantized = repack.quantize && kept(Position);
+      for(int slot : {Position, Normal, Texcoord_0}) {
+        if(kept(slot) && !quantizable(slot, accessors[primitive.attributes[slot]])) quantized = false;
+      }
+
+      int stride = 0;
+      for(int slot = 0; slot < Attribute_Count; ++slot) {
+        if(!kept(slot)) continue;
+        const auto& accessor = accessors[primitive.attributes[slot]];
+        if(accessor.buffer_view == Invalid_Buffer_View_Handle || accessor.count != vertex_count || accessor.element_size() <= 0) return 0;
+
+        auto& attribute = format.attributes[slot];
+        attribute = {Invalid_Buffer_View_Handle, accessor.component_type, component_count(accessor.type), accessor.normalized, 0, stride};
+        int size = accessor.element_size();
+        if(quantized && slot == Position) {
+          attribute.component_type = GL_UNSIGNED_SHORT;
+          attribute.normalized = true;
+          size = 3 * sizeof(uint16_t);
+        } else if(quantized && slot == Normal) {
+          attribute.component_type = GL_SHORT;
+          attribute.components = 2;
+          attribute.normalized = true;
+          size = 2 * sizeof(int16_t);
+        } else if(quantized && slot == Texcoord_0) {
+          attribute.component_type = GL_HALF_FLOAT;
+          size = 2 * sizeof(uint16_t);
+        }
+        stride += (size + 3) & ~3;
+      }
+
+      for(auto& attribute : format.attributes) {
+        if(attribute.components != 0) attribute.byte_stride = stride;
+      }
+      return stride;
+    }
+
+    // One new buffer per mesh with a bufferView per stream, all sized up front so the GL side can
+    // size its tables before prepare_mesh() writes any vertex. Primitives that read the same
+    // accessors share a stream.
+    void add_repacked_buffer_views() {
+      repacked_buffer_views.assign(meshes.size(), {});
+      if(repack.optimize) {
+        optimized_index_buffer_views.assign(meshes.size(), {});
+        optimized_index_types.assign(meshes.size(), {});
+        optimize_stats.assign(meshes.size(), {});
+      }
+      for(int mesh_index = 0; mesh_index < meshes.size(); ++mesh_index) {
+        const auto& primitives = meshes[mesh_index].primitives;
+        auto& views = repacked_buffer_views[mesh_index];
+        views.assign(primitives.size(), Invalid_Buffer_View_Handle);
+
+        const int buffer_index = int(buffers.size());
+        size_t buffer_length = 0;
+        std::map<std::array<Accessor_Handle, Attribute_Count>, Buffer_View_Handle> streams;
+        for(int primitive_index = 0; primitive_index < primitives.size(); ++primitive_index) {
+          const auto& primitive = primitives[primitive_index];
+          Vertex_Layout format;
+          bool quantized;
+          const int stride = repacked_vertex_format(primitive, format, quantized);
+          if(stride == 0) continue;
+
+          std::array<Accessor_Handle, Attribute_Count> kept;
+          for(int slot = 0; slot < Attribute_Count; ++slot) kept[slot] = format.attributes[slot].components != 0 ? primitive.attributes[slot] : Invalid_Accessor_Handle;
+          if(auto it = streams.find(kept); it != streams.end()) {
+            views[primitive_index] = it->second;
+            continue;
+          }
+
+          Buffer_View buffer_view;
+          buffer_view.buffer = buffer_index;
+          buffer_view.byte_offset = buffer_length;
+          buffer_view.byte_length = size_t(accessors[primitive.attributes[Position]].count) * stride;
+          buffer_view.byte_stride = stride;
+          buffer_view.target = GL_ARRAY_BUFFER;
+          buffer_length += buffer_view.byte_length;
+
+          views[primitive_index] = Buffer_View_Handle(buffer_views.size());
+          streams.emplace(kept, views[primitive_index]);
+          buffer_views.push_back(buffer_view);
+        }
+        if(repack.optimize) add_optimized_index_buffer_views(mesh_index, buffer_index, buffer_length);
+
+        if(buffer_length > 0) {
+          auto& buffer = buffers.emplace_back();
+          buffer.byte_length = buffer_length;
+          buffer.repacked = true;
+        }
+      }
+    }
+
+    // Index count of a triangle list the geometry optimizer can take, or 0.
+    int optimizable_index_count(const Primitive& primitive) const {
+      if(primitive.mode != Primitive_Mode::Triangles) return 0;
+      int count = accessors[primitive.attributes[Position]].count;
+      if(primitive.indices != Invalid_Accessor_Handle) {
+        const auto& accessor = accessors[primitive.indices];
+        if(accessor.buffer_view == Invalid_Buffer_View_Handle) return 0;
+        count = accessor.count;
+      }
+      return count > 0 && count % 3 == 0 ? count : 0;
+    }
+
+    // A 32 bit index bufferView per primitive, in the mesh's repacked buffer, shrunk once the optimizer
+    // narrowed the indices. The optimizer renumbers a stream's vertices for every primitive drawing
+    // from it, so streams that any non triangle list primitive reads are left alone.
+    void add_optimized_index_buffer_views(int mesh_index, int buffer_index, size_t& buffer_length) {
+      const auto& primitives = meshes[mesh_index].primitives;
+      const auto& streams = repacked_buffer_views[mesh_index];
+      auto& views = optimized_index_buffer_views[mesh_index];
+      views.assign(primitives.size(), Invalid_Buffer_View_Handle);
+      optimized_index_types[mesh_index].assign(primitives.size(), Component_Type{});
+
+      for(int primitive_index = 0; primitive_index < primitives.size(); ++primitive_index) {
+        const auto stream = streams[primitive_index];
+        if(stream == Invalid_Buffer_View_Handle) continue;
+        bool optimizable = true;
+        for(int other = 0; other < primitives.size(); ++other) {
+          if(streams[other] == stream && optimizable_index_count(primitives[other]) == 0) optimizable = false;
+        }
+        if(!optimizable) continue;
+
+        Buffer_View buffer_view;
+        buffer_view.buffer = buffer_index;
+        buffer_view.byte_offset = buffer_length;
+        buffer_view.byte_length = size_t(optimizable_index_count(primitives[primitive_index])) * sizeof(uint32_t);
+        buffer_view.target = GL_ELEMENT_ARRAY_BUFFER;
+        buffer_length += buffer_view.byte_length;
+
+        views[primitive_index] = Buffer_View_Handle(buffer_views.size());
+        buffer_views.push_back(buffer_view);
+      }
+    }
+
+    template<size_t Size>
+    static void copy_elements(const unsigned char* from, size_t from_stride, unsigned char* to, size_t to_stride, size_t count) {
+      for(size_t i = 0; i < count; ++i, from += from_stride, to += to_stride) std::memcpy(to, from, Size);
+    }
+
+    // Quantized positions are relative to the mesh bounds, see Mesh::dequantization.
+    bool write_quantized_attribute(const Mesh& mesh, int slot, Accessor_Handle accessor_handle, unsigned char* to, size_t stride, size_t vertex_count) const {
+      if(slot == Texcoord_0) {
+        const Accessor_View<glm::vec2> texcoords(*this, accessor_handle);
+        if(texcoords.size() != vertex_count) return false;
+        for(size_t i = 0; i < vertex_count; ++i, to += stride) {
+          const glm::vec2 texcoord = texcoords[i];
+          const uint16_t packed[2] = {float_to_half(texcoord.x), float_to_half(texcoord.y)};
+          std::memcpy(to, packed, sizeof(packed));
+        }
+        return true;
+      }
+
+      const Accessor_View<glm::vec3> values(*this, accessor_handle);
+      if(values.size() != vertex_count) return false;
+      if(slot == Normal) {
+        for(size_t i = 0; i < vertex_count; ++i, to += stride) {
+          const auto packed = octahedral_encode(values[i]);
+          std::memcpy(to, packed.data(), sizeof(packed));
+        }
+        return true;
+      }
+
+      const glm::vec3 extent = mesh.max - mesh.min;
+      const glm::vec3 inverse_extent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f, extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+      for(size_t i = 0; i < vertex_count; ++i, to += stride) {
+        const glm::vec3 unit = (values[i] - mesh.min) * inverse_extent;
+        const uint16_t packed[3] = {float_to_unorm16(unit.x), float_to_unorm16(unit.y), float_to_unorm16(unit.z)};
+        std::memcpy(to, packed, sizeof(packed));
+      }
+      return true;
+    }
+
+    // Runs on a worker thread, inside prepare_mesh(). Interleaves the kept attributes of every
+    // vertex into the stream. Fails when an attribute reads past its bufferView.
+    bool write_repacked_vertices(const Mesh& mesh, const Primitive& primitive, Buffer_View_Handle buffer_view_handle, const Vertex_Layout& format) {
+      const auto& buffer_view = buffer_views[buffer_view_handle];
+      auto& buffer = buffers[buffer_view.buffer];
+      // The mesh's own buffer, no other task touches it.
+      if(buffer.owned.empty()) {
+        buffer.owned.assign(buffer.byte_length, 0);
+        buffer.bytes = buffer.owned;
+      }
+
+      const size_t stride = size_t(buffer_view.byte_stride);
+      const size_t vertex_count = buffer_view.byte_length / stride;
+      unsigned char* destination = buffer.owned.data() + buffer_view.byte_offset;
+
+      for(int slot = 0; slot < Attribute_Count; ++slot) {
+        const auto& attribute = format.attributes[slot];
+        if(attribute.components == 0) continue;
+        const auto& accessor = accessors[primitive.attributes[slot]];
+        unsigned char* to = destination + attribute.byte_offset;
+
+        if(attribute.component_type != accessor.component_type) {
+          if(!write_quantized_attribute(mesh, slot, primitive.attributes[slot], to, stride, vertex_count)) return false;
+          continue;
+        }
+
+        const size_t element_size = size_t(accessor.element_size());
+        const size_t source_stride = buffer_views[accessor.buffer_view].byte_stride != 0 ? size_t(buffer_views[accessor.buffer_view].byte_stride) : element_size;
+        const auto source = buffer_view_data(accessor.buffer_view);
+        if(source.empty() || size_t(accessor.byte_offset) + (vertex_count - 1) * source_stride + element_size > source.size()) return false;
+
+        const unsigned char* from = source.data() + accessor.byte_offset;
+        switch (element_size) {
+          case 4:  { copy_elements<4>(from, source_stride, to, stride, vertex_count);  break; }
+          case 8:  { copy_elements<8>(from, source_stride, to, stride, vertex_count);  break; }
+          case 12: { copy_elements<12>(from, source_stride, to, stride, vertex_count); break; }
+          case 16: { copy_elements<16>(from, source_stride, to, stride, vertex_count); break; }
+          default: {
+            for(size_t i = 0; i < vertex_count; ++i) std::memcpy(to + i * stride, from + i * source_stride, element_size);
+          }
+        }
+      }
+      return true;
+    }
+
+    // Replaces the layout with the repacked stream. False leaves the primitive on its original layout.
+    bool repack_primitive(int mesh_index, int primitive_index, std::vector<Buffer_View_Handle>& written, Vertex_Layout& layout, int& vertex_count, bool& quantized) {
+      if(repacked_buffer_views.empty()) return false;
+      const auto buffer_view_handle = repacked_buffer_views[mesh_index][primitive_index];
+      if(buffer_view_handle == Invalid_Buffer_View_Handle) return false;
+
+      auto& mesh = meshes[mesh_index];
+      const auto& primitive = mesh.primitives[primitive_index];
+      Vertex_Layout format;
+      const int stride = repacked_vertex_format(primitive, format, quantized);
+      vertex_count = accessors[primitive.attributes[Position]].count;
+
+      if(std::find(written.begin(), written.end(), buffer_view_handle) == written.end()) {
+        if(!write_repacked_vertices(mesh, primitive, buffer_view_handle, format)) {
+          std::cout << "Not repacking primitive " << primitive_index << " of mesh " << mesh_index << ": an attribute is out of range." << std::endl;
+          quantized = false;
+          return false;
+        }
+        written.push_back(buffer_view_handle);
+        optimize_stream(mesh_index, buffer_view_handle);
+
+        // Before: every bufferView the original layout binds, once each.
+        std::vector<Buffer_View_Handle> source_views;
+        size_t source_stride = 0;
+        for(auto accessor_handle : primitive.attributes) {
+          if(accessor_handle == Invalid_Accessor_Handle) continue;
+          const auto& accessor = accessors[accessor_handle];
+          if(accessor.buffer_view == Invalid_Buffer_View_Handle) continue;
+          if(std::find(source_views.begin(), source_views.end(), accessor.buffer_view) != source_views.end()) continue;
+          source_views.push_back(accessor.buffer_view);
+          const int view_stride = buffer_views[accessor.buffer_view].byte_stride;
+          source_stride += view_stride != 0 ? view_stride : accessor.element_size();
+        }
+        ++repack_stats.streams;
+        repack_stats.vertices += size_t(vertex_count);
+        repack_stats.source_bytes += source_stride * vertex_count;
+        repack_stats.packed_bytes += size_t(stride) * vertex_count;
+      }
+
+      if(quantized) {
+        // unorm16 back to the mesh bounds, applied on top of the node transform when drawing.
+        mesh.dequantization = glm::translate(glm::mat4(1.0f), mesh.min) * glm::scale(glm::mat4(1.0f), mesh.max - mesh.min);
+      }
+
+      layout = format;
+      for(auto& attribute : layout.attributes) {
+        if(attribute.components != 0) attribute.buffer_view = buffer_view_handle;
+      }
+      return true;
+    }
+
+    // Runs on a worker thread, inside prepare_mesh(), right after the stream was written. Optimizes
+    // the stream together with the indices of every primitive drawing from it, or leaves all of them
+    // on their original indices when one can't be read.
+    void optimize_stream(int mesh_index, Buffer_View_Handle stream) {
+      if(optimized_index_buffer_views.empty()) return;
+      const auto& mesh = meshes[mesh_index];
+      std::vector<int> primitive_indices;
+      for(int primitive_index = 0; primitive_index < mesh.primitives.size(); ++primitive_index) {
+        if(repacked_buffer_views[mesh_index][primitive_index] == stream &&
+           optimized_index_buffer_views[mesh_index][primitive_index] != Invalid_Buffer_View_Handle) {
+          primitive_indices.push_back(primitive_index);
+        }
+      }
+      if(primitive_indices.empty()) return;
+
+      auto& stream_view = buffer_views[stream];
+      auto& buffer = buffers[stream_view.buffer];
+      const size_t stride = size_t(stream_view.byte_stride);
+      const size_t vertex_count = stream_view.byte_length / stride;
+      const std::span<unsigned char> vertices(buffer.owned.data() + stream_view.byte_offset, stream_view.byte_length);
+      const Accessor_View<glm::vec3> source_positions(*this, mesh.primitives[primitive_indices.front()].attributes[Position]);
+      if(source_positions.size() != vertex_count) return;
+
+      // Every index list back to back, in draw order, which is also the order vertex fetch follows.
+      std::vector<uint32_t> indices;
+      std::vector<size_t> firsts;
+      for(int primitive_index : primitive_indices) {
+        const auto& primitive = mesh.primitives[primitive_index];
+        firsts.push_back(indices.size());
+        if(primitive.indices == Invalid_Accessor_Handle) {
+          indices.resize(indices.size() + vertex_count);
+          std::iota(indices.begin() + firsts.back(), indices.end(), 0u);
+          continue;
+        }
+
+        const Accessor_View<uint32_t> primitive_indices_view(*this, primitive.indices);
+        bool in_range = primitive_indices_view.size() == size_t(accessors[primitive.indices].count);
+        for(uint32_t index : primitive_indices_view) {
+          in_range = in_range && index < vertex_count;
+          indices.push_back(index);
+        }
+        if(!in_range) {
+          std::cout << "Not optimizing primitive " << primitive_index << " of mesh " << mesh_index << ": indices are out of range." << std::endl;
+          return;
+        }
+      }
+      firsts.push_back(indices.size());
+      auto primitive_span = [&](size_t i) { return std::span(indices).subspan(firsts[i], firsts[i + 1] - firsts[i]); };
+
+      const Vertex_Cache_Stats before = analyze_vertex_cache(indices, vertex_count);
+
+      std::vector<uint32_t> remap;
+      const size_t welded_count = weld_vertices(vertices, stride, remap);
+      std::vector<unsigned char> welded(welded_count * stride);
+      std::vector<glm::vec3> positions(welded_count);
+      for(size_t vertex = 0; vertex < vertex_count; ++vertex) {
+        std::memcpy(welded.data() + remap[vertex] * stride, vertices.data() + vertex * stride, stride);
+        positions[remap[vertex]] = source_positions[vertex];
+      }
+      for(uint32_t& index : indices) index = remap[index];
+
+      for(size_t i = 0; i < primitive_indices.size(); ++i) {
+        optimize_vertex_cache(primitive_span(i), welded_count);
+        optimize_overdraw(primitive_span(i), positions);
+      }
+      const size_t optimized_count = optimize_vertex_fetch(welded, stride, indices);
+      std::memcpy(vertices.data(), welded.data(), optimized_count * stride);
+      stream_view.byte_length = optimized_count * stride;
+
+      const Vertex_Cache_Stats after = analyze_vertex_cache(indices, optimized_count);
+      auto& stats = optimize_stats[mesh_index];
+      for(auto [total, stream_stats] : {std::pair{&stats.before, before}, std::pair{&stats.after, after}}) {
+        total->misses += stream_stats.misses;
+        total->triangles += stream_stats.triangles;
+        total->vertices += stream_stats.vertices;
+      }
+
+      // 0xFFFF stays unused, it is the primitive restart index.
+      const bool narrow = optimized_count <= 0xFFFF;
+      for(size_t i = 0; i < primitive_indices.size(); ++i) {
+        const auto primitive_index = primitive_indices[i];
+        auto& index_view = buffer_views[optimized_index_buffer_views[mesh_index][primitive_index]];
+        unsigned char* to = buffer.owned.data() + index_view.byte_offset;
+        const auto span = primitive_span(i);
+        if(narrow) {
+          for(size_t k = 0; k < span.size(); ++k) {
+            const uint16_t index = uint16_t(span[k]);
+            std::memcpy(to + k * sizeof(uint16_t), &index, sizeof(uint16_t));
+          }
+          index_view.byte_length = span.size() * sizeof(uint16_t);
+        } else {
+          std::memcpy(to, span.data(), span.size_bytes());
+        }
+        optimized_index_types[mesh_index][primitive_index] = narrow ? Component_Type::Unsigned_Short : Component_Type::Unsigned_Int;
+      }
+    }
+
+  };
+
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <span>
+#include <cstddef>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. The pages are backed by the file itself, so
+// they don't count against the heap and the OS can drop them under pressure.
+struct Mapped_File {
+  const unsigned char* data = nullptr;
+  size_t size{};
+
+  Mapped_File() = default;
+  Mapped_File(const Mapped_File&) = delete;
+  Mapped_File& operator=(const Mapped_File&) = delete;
+
+  bool open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file_handle == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size{};
+    GetFileSizeEx(file_handle, &file_size);
+    size = size_t(file_size.QuadPart);
+    if(size == 0) return true;
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping_handle == nullptr) { close(); return false; }
+
+    data = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if(data == nullptr) { close(); return false; }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) != 0) { ::close(fd); return false; }
+    size = size_t(file_stat.st_size);
+    if(size == 0) { ::close(fd); return true; }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if(mapping == MAP_FAILED) { size = 0; return false; }
+
+    // We walk the file front to back once, so let the kernel read ahead aggressively.
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    data = static_cast<const unsigned char*>(mapping);
+#endif
+    return true;
+  }
+
+  std::span<const unsigned char> bytes() const {
+    return {data, size};
+  }
+
+  void close() {
+#ifdef _WIN32
+    if(data) UnmapViewOfFile(data);
+    if(mapping_handle) CloseHandle(mapping_handle);
+    if(file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = INVALID_HANDLE_VALUE;
+#else
+    if(data) munmap(const_cast<unsigned char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+  }
+
+  ~Mapped_File() {
+    close();
+  }
+
+private:
+#ifdef _WIN32
+  HANDLE file_handle = INVALID_HANDLE_VALUE;
+  HANDLE mapping_handle = nullptr;
+#endif
+};
@@ -0,0 +1,498 @@
+#pragma once
+
+#include "common.h"
+
+#include <span>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+// Same runtime dispatch as base64.h, the rest of the build doesn't need -mssse3.
+#define GLTF_MESHOPT_X86 1
+#define GLTF_MESHOPT_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Decoders for the EXT_meshopt_compression bitstreams (meshoptimizer's vertex codec version 0,
+// index codec versions 0 and 1, index sequence codec version 1) and its filters.
+//
+// The vertex codec stores each byte of a vertex as its own column of zigzag encoded deltas to the
+// previous vertex, in groups of 16 packed to 0, 2, 4 or 8 bits. The SSSE3 path unpacks a group with
+// one shuffle, and transposes four columns back into vertices while summing the deltas four
+// vertices at a time. The index codecs are a chain of FIFO lookups, one triangle depending on the
+// last, so they stay scalar.
+
+namespace gltf {
+
+  namespace meshopt_detail {
+
+    constexpr unsigned char Vertex_Header = 0xA0;
+    constexpr unsigned char Index_Header = 0xE0;
+    constexpr unsigned char Sequence_Header = 0xD0;
+
+    constexpr size_t Byte_Group_Size = 16;
+    // The most a group can read: 8 bytes of 4 bit selectors and 16 literals.
+    constexpr size_t Byte_Group_Decode_Limit = 24;
+    constexpr size_t Vertex_Block_Size_Bytes = 8192;
+    constexpr size_t Vertex_Block_Max_Size = 256;
+    // The first vertex, padded to at least this much, ends the stream. Keeps group reads in bounds.
+    constexpr size_t Tail_Min_Size = 32;
+
+    inline size_t vertex_block_size(size_t stride) {
+      return std::min(Vertex_Block_Size_Bytes / stride & ~size_t(15), Vertex_Block_Max_Size);
+    }
+
+    inline unsigned char unzigzag8(unsigned char value) {
+      return static_cast<unsigned char>(-(value & 1) ^ (value >> 1));
+    }
+
+    // 16 values of 0, 2, 4 or 8 bits, most significant first. The largest 2 or 4 bit value means
+    // the byte is stored in full, after the selectors.
+    inline const unsigned char* decode_bytes_group(const unsigned char* data, unsigned char* out, int bits_log2) {
+      if(bits_log2 == 0) {
+        std::memset(out, 0, Byte_Group_Size);
+        return data;
+      }
+      if(bits_log2 == 3) {
+        std::memcpy(out, data, Byte_Group_Size);
+        return data + Byte_Group_Size;
+      }
+
+      const int bits = 1 << bits_log2;
+      const unsigned sentinel = (1u << bits) - 1;
+      const unsigned char* literal = data + bits * 2;
+      for(int i = 0; i < Byte_Group_Size; ++i) {
+        const unsigned value = (data[i * bits / 8] >> (8 - bits - i * bits % 8)) & sentinel;
+        out[i] = value == sentinel ? *literal++ : static_cast<unsigned char>(value);
+      }
+      return literal;
+    }
+
+#ifdef GLTF_MESHOPT_X86
+    // For each mask of literal positions among 8 values, where each one reads from the literals.
+    inline constexpr auto group_shuffles = [] {
+      std::array<std::array<uint8_t, 8>, 256> table{};
+      for(int mask = 0; mask < 256; ++mask) {
+        uint8_t next = 0;
+        for(int bit = 0; bit < 8; ++bit) table[mask][bit] = (mask >> bit) & 1 ? next++ : 0x80;
+      }
+      return table;
+    }();
+
+    GLTF_MESHOPT_TARGET("ssse3")
+    inline const unsigned char* decode_bytes_group_ssse3(const unsigned char* data, unsigned char* out, int bits_log2) {
+      __m128i values;
+      const unsigned char* literals;
+      int sentinel;
+
+      switch (bits_log2) {
+        case 0: {
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_setzero_si128());
+          return data;
+        }
+        case 1: {
+          int selectors;
+          std::memcpy(&selectors, data, sizeof(selectors));
+          // Nibbles to bytes, then 2 bit pairs to bytes, each time interleaving the high half first.
+          const __m128i packed = _mm_cvtsi32_si128(selectors);
+          const __m128i nibbles = _mm_unpacklo_epi8(_mm_srli_epi16(packed, 4), packed);
+          values = _mm_and_si128(_mm_unpacklo_epi8(_mm_srli_epi16(nibbles, 2), nibbles), _mm_set1_epi8(3));
+          literals = data + 4;
+          sentinel = 3;
+          break;
+        }
+        case 2: {
+          const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+          values = _mm_and_si128(_mm_unpacklo_epi8(_mm_srli_epi16(packed, 4), packed), _mm_set1_epi8(15));
+          literals = data + 8;
+          sentinel = 15;
+          break;
+        }
+        default: {
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+          return data + Byte_Group_Size;
+        }
+      }
+
+      // The group read limit covers loading 16 literals no matter how many there are.
+      const __m128i is_literal = _mm_cmpeq_epi8(values, _mm_set1_epi8(char(sentinel)));
+      const int mask = _mm_movemask_epi8(is_literal);
+      const int low_count = std::popcount(unsigned(mask & 0xFF));
+      const __m128i low = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(group_shuffles[mask & 0xFF].data()));
+      const __m128i high = _mm_add_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(group_shuffles[mask >> 8].data())), _mm_set1_epi8(char(low_count)));
+      const __m128i gathered = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(literals)), _mm_unpacklo_epi64(low, high));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_or_si128(gathered, _mm_andnot_si128(is_literal, values)));
+      return literals + std::popcount(unsigned(mask));
+    }
+#endif
+
+  };
+
+  enum class Meshopt_Isa {
+    Scalar,
+    Ssse3,
+  };
+
+  inline Meshopt_Isa meshopt_best_isa() {
+#ifdef GLTF_MESHOPT_X86
+    static const Meshopt_Isa isa = [] {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("ssse3") ? Meshopt_Isa::Ssse3 : Meshopt_Isa::Scalar;
+    }();
+    return isa;
+#else
+    return Meshopt_Isa::Scalar;
+#endif
+  }
+
+  namespace meshopt_detail {
+
+    // A column of size bytes, a multiple of the group size, behind a 2 bit size selector per group.
+    inline const unsigned char* decode_bytes(const unsigned char* data, const unsigned char* end, unsigned char* out, size_t size, Meshopt_Isa isa) {
+      const unsigned char* selectors = data;
+      const size_t selector_size = (size / Byte_Group_Size + 3) / 4;
+      if(size_t(end - data) < selector_size) return nullptr;
+      data += selector_size;
+
+      for(size_t i = 0; i < size; i += Byte_Group_Size) {
+        if(size_t(end - data) < Byte_Group_Decode_Limit) return nullptr;
+        const size_t group = i / Byte_Group_Size;
+        const int bits_log2 = (selectors[group / 4] >> (group % 4 * 2)) & 3;
+#ifdef GLTF_MESHOPT_X86
+        if(isa == Meshopt_Isa::Ssse3) {
+          data = decode_bytes_group_ssse3(data, out + i, bits_log2);
+          continue;
+        }
+#endif
+        data = decode_bytes_group(data, out + i, bits_log2);
+      }
+      return data;
+    }
+
+    inline const unsigned char* decode_vertex_block(const unsigned char* data, const unsigned char* end, unsigned char* out, size_t count, size_t stride, unsigned char* last_vertex) {
+      unsigned char column[Vertex_Block_Max_Size];
+      const size_t aligned = (count + Byte_Group_Size - 1) & ~(Byte_Group_Size - 1);
+
+      for(size_t k = 0; k < stride; ++k) {
+        data = decode_bytes(data, end, column, aligned, Meshopt_Isa::Scalar);
+        if(data == nullptr) return nullptr;
+
+        unsigned char previous = last_vertex[k];
+        for(size_t i = 0; i < count; ++i) {
+          previous = static_cast<unsigned char>(unzigzag8(column[i]) + previous);
+          out[i * stride + k] = previous;
+        }
+      }
+      std::memcpy(last_vertex, out + (count - 1) * stride, stride);
+      return data;
+    }
+
+#ifdef GLTF_MESHOPT_X86
+    // Four columns at a time: each 16 vertex slice is transposed into four registers of four
+    // vertices, whose deltas are summed with two shifted adds on top of the previous vertex.
+    GLTF_MESHOPT_TARGET("ssse3")
+    inline const unsigned char* decode_vertex_block_ssse3(const unsigned char* data, const unsigned char* end, unsigned char* out, size_t count, size_t stride, unsigned char* last_vertex) {
+      alignas(16) unsigned char columns[4][Vertex_Block_Max_Size];
+      const size_t aligned = (count + Byte_Group_Size - 1) & ~(Byte_Group_Size - 1);
+
+      for(size_t k = 0; k < stride; k += 4) {
+        for(auto& column : columns) {
+          data = decode_bytes(data, end, column, aligned, Meshopt_Isa::Ssse3);
+          if(data == nullptr) return nullptr;
+        }
+
+        int last;
+        std::memcpy(&last, last_vertex + k, sizeof(last));
+        __m128i previous = _mm_set1_epi32(last);
+
+        for(size_t i = 0; i < count; i += Byte_Group_Size) {
+          const __m128i c0 = _mm_load_si128(reinterpret_cast<const __m128i*>(columns[0] + i));
+          const __m128i c1 = _mm_load_si128(reinterpret_cast<const __m128i*>(columns[1] + i));
+          const __m128i c2 = _mm_load_si128(reinterpret_cast<const __m128i*>(columns[2] + i));
+          const __m128i c3 = _mm_load_si128(reinterpret_cast<const __m128i*>(columns[3] + i));
+          const __m128i low01 = _mm_unpacklo_epi8(c0, c1), low23 = _mm_unpacklo_epi8(c2, c3);
+          const __m128i high01 = _mm_unpackhi_epi8(c0, c1), high23 = _mm_unpackhi_epi8(c2, c3);
+          const __m128i vertices[4] = {
+            _mm_unpacklo_epi16(low01, low23), _mm_unpackhi_epi16(low01, low23),
+            _mm_unpacklo_epi16(high01, high23), _mm_unpackhi_epi16(high01, high23),
+          };
+
+          for(int quad = 0; quad < 4; ++quad) {
+            __m128i v = vertices[quad];
+            v = _mm_xor_si128(_mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi8(1))), _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7F)));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi8(v, previous);
+            previous = _mm_shuffle_epi32(v, 0xFF);
+
+            alignas(16) unsigned char decoded[16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(decoded), v);
+            const size_t first = i + quad * 4;
+            for(size_t j = 0; j < 4 && first + j < count; ++j) std::memcpy(out + (first + j) * stride + k, decoded + j * 4, 4);
+          }
+        }
+      }
+      std::memcpy(last_vertex, out + (count - 1) * stride, stride);
+      return data;
+    }
+#endif
+
+    inline unsigned decode_vbyte(const unsigned char*& data) {
+      const unsigned char lead = *data++;
+      if(lead < 128) return lead;
+
+      unsigned result = lead & 127;
+      unsigned shift = 7;
+      for(int i = 0; i < 4; ++i) {
+        const unsigned char group = *data++;
+        result |= unsigned(group & 127) << shift;
+        shift += 7;
+        if(group < 128) break;
+      }
+      return result;
+    }
+
+    inline unsigned decode_index(const unsigned char*& data, unsigned last) {
+      const unsigned value = decode_vbyte(data);
+      return last + ((value >> 1) ^ -int(value & 1));
+    }
+
+    inline void write_index(unsigned char* destination, size_t i, size_t index_size, unsigned index) {
+      if(index_size == 2) {
+        const uint16_t narrow = uint16_t(index);
+        std::memcpy(destination + i * 2, &narrow, 2);
+      } else {
+        std::memcpy(destination + i * 4, &index, 4);
+      }
+    }
+
+  };
+
+  // ATTRIBUTES: count vertices of stride bytes, stride a multiple of 4 up to 256.
+  inline bool meshopt_decode_vertex_buffer(unsigned char* destination, size_t count, size_t stride, std::span<const unsigned char> encoded, Meshopt_Isa isa = meshopt_best_isa()) {
+    using namespace meshopt_detail;
+    if(stride == 0 || stride > 256 || stride % 4 != 0) return false;
+    const size_t tail_size = std::max(stride, Tail_Min_Size);
+    if(encoded.size() < 1 + tail_size || encoded[0] != Vertex_Header) return false;
+
+    const unsigned char* data = encoded.data() + 1;
+    const unsigned char* end = encoded.data() + encoded.size();
+    unsigned char last_vertex[256];
+    std::memcpy(last_vertex, end - stride, stride);
+
+    const size_t block_size = vertex_block_size(stride);
+    for(size_t offset = 0; offset < count; offset += block_size) {
+      const size_t block_count = std::min(block_size, count - offset);
+      unsigned char* out = destination + offset * stride;
+#ifdef GLTF_MESHOPT_X86
+      if(isa == Meshopt_Isa::Ssse3) {
+        data = decode_vertex_block_ssse3(data, end, out, block_count, stride, last_vertex);
+        if(data == nullptr) return false;
+        continue;
+      }
+#endif
+      data = decode_vertex_block(data, end, out, block_count, stride, last_vertex);
+      if(data == nullptr) return false;
+    }
+    return size_t(end - data) == tail_size;
+  }
+
+  // TRIANGLES: count indices of index_size bytes, count a multiple of 3. Each triangle is a code
+  // byte naming a recent edge and/or recent vertices in two 16 entry FIFOs, with new vertices
+  // numbered in order and anything else stored as a delta to the last one stored.
+  inline bool meshopt_decode_index_buffer(unsigned char* destination, size_t count, size_t index_size, std::span<const unsigned char> encoded) {
+    using namespace meshopt_detail;
+    if(count % 3 != 0 || (index_size != 2 && index_size != 4)) return false;
+    // Header, a code per triangle and the 16 byte table of common codes at the end.
+    if(encoded.size() < 1 + count / 3 + 16 || (encoded[0] & 0xF0) != Index_Header) return false;
+    const int version = encoded[0] & 0x0F;
+    if(version > 1) return false;
+
+    unsigned edges[16][2];
+    unsigned vertices[16];
+    std::memset(edges, -1, sizeof(edges));
+    std::memset(vertices, -1, sizeof(vertices));
+    size_t edge_offset = 0;
+    size_t vertex_offset = 0;
+    auto push_edge = [&](unsigned a, unsigned b) {
+      edges[edge_offset][0] = a;
+      edges[edge_offset][1] = b;
+      edge_offset = (edge_offset + 1) & 15;
+    };
+    auto push_vertex = [&](unsigned v, bool push = true) {
+      vertices[vertex_offset] = v;
+      vertex_offset = (vertex_offset + push) & 15;
+    };
+
+    unsigned next = 0;
+    unsigned last = 0;
+    // Version 1 codes 13 and 14 as last - 1 and last + 1.
+    const int fifo_codes = version >= 1 ? 13 : 15;
+
+    const unsigned char* code = encoded.data() + 1;
+    const unsigned char* data = code + count / 3;
+    // A triangle reads at most 16 bytes, the size of the table: no other bounds checks are needed.
+    const unsigned char* data_safe_end = encoded.data() + encoded.size() - 16;
+    const unsigned char* code_table = data_safe_end;
+
+    for(size_t i = 0; i < count; i += 3) {
+      if(data > data_safe_end) return false;
+      const unsigned char triangle_code = *code++;
+
+      if(triangle_code < 0xF0) {
+        // An edge from the FIFO and a third vertex.
+        const int fe = triangle_code >> 4;
+        const unsigned a = edges[(edge_offset - 1 - fe) & 15][0];
+        const unsigned b = edges[(edge_offset - 1 - fe) & 15][1];
+        const int fec = triangle_code & 15;
+        unsigned c;
+        if(fec < fifo_codes) {
+          c = fec == 0 ? next++ : vertices[(vertex_offset - 1 - fec) & 15];
+          push_vertex(c, fec == 0);
+        } else {
+          last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decode_index(data, last);
+          push_vertex(c);
+        }
+        write_index(destination, i + 0, index_size, a);
+        write_index(destination, i + 1, index_size, b);
+        write_index(destination, i + 2, index_size, c);
+        push_edge(c, b);
+        push_edge(a, c);
+      } else {
+        int feb, fec;
+        unsigned a, b, c;
+        if(triangle_code < 0xFE) {
+          // A new vertex and two from the table, all three are pushed so later codes can name them.
+          const unsigned char aux = code_table[triangle_code & 15];
+          feb = aux >> 4;
+          fec = aux & 15;
+          a = next++;
+          b = feb == 0 ? next++ : vertices[(vertex_offset - feb) & 15];
+          c = fec == 0 ? next++ : vertices[(vertex_offset - fec) & 15];
+        } else {
+          const unsigned char aux = *data++;
+          feb = aux >> 4;
+          fec = aux & 15;
+          // A zero aux byte restarts the new vertex numbering.
+          if(aux == 0) next = 0;
+          a = triangle_code == 0xFE ? next++ : 0;
+          b = feb == 0 ? next++ : vertices[(vertex_offset - feb) & 15];
+          c = fec == 0 ? next++ : vertices[(vertex_offset - fec) & 15];
+          if(triangle_code == 0xFF) last = a = decode_index(data, last);
+          if(feb == 15) last = b = decode_index(data, last);
+          if(fec == 15) last = c = decode_index(data, last);
+        }
+        write_index(destination, i + 0, index_size, a);
+        write_index(destination, i + 1, index_size, b);
+        write_index(destination, i + 2, index_size, c);
+        push_vertex(a);
+        push_vertex(b, feb == 0 || feb == 15);
+        push_vertex(c, fec == 0 || fec == 15);
+        push_edge(b, a);
+        push_edge(c, b);
+        push_edge(a, c);
+      }
+    }
+    return data == data_safe_end;
+  }
+
+  // INDICES: count indices of index_size bytes, each a delta to one of the last two.
+  inline bool meshopt_decode_index_sequence(unsigned char* destination, size_t count, size_t index_size, std::span<const unsigned char> encoded) {
+    using namespace meshopt_detail;
+    if(index_size != 2 && index_size != 4) return false;
+    // Header, a byte per index at least and a 4 byte tail.
+    if(encoded.size() < 1 + count + 4 || (encoded[0] & 0xF0) != Sequence_Header || (encoded[0] & 0x0F) > 1) return false;
+
+    const unsigned char* data = encoded.data() + 1;
+    // An index reads at most 5 bytes, the tail covers what runs past.
+    const unsigned char* data_safe_end = encoded.data() + encoded.size() - 4;
+    unsigned last[2] = {};
+    for(size_t i = 0; i < count; ++i) {
+      if(data >= data_safe_end) return false;
+      unsigned value = decode_vbyte(data);
+      const unsigned baseline = value & 1;
+      value >>= 1;
+      last[baseline] += (value >> 1) ^ -int(value & 1);
+      write_index(destination, i, index_size, last[baseline]);
+    }
+    return data == data_safe_end;
+  }
+
+  // Undoes the filter the encoder ran before compressing. Strides have to match what it supports.
+  inline bool meshopt_decode_filter(Meshopt_Filter filter, unsigned char* data, size_t count, size_t stride) {
+    auto rounded = [](float value) { return int(value + (value >= 0.0f ? 0.5f : -0.5f)); };
+
+    switch (filter) {
+      case Meshopt_Filter::None: return true;
+
+      // x and y on the octahedron, z holding what 1.0 is at this bit count. Back to a unit vector.
+      case Meshopt_Filter::Octahedral: {
+        if(stride != 4 && stride != 8) return false;
+        auto decode = [&]<typename T>(T* values) {
+          const float one = float((1 << (sizeof(T) * 8 - 1)) - 1);
+          for(size_t i = 0; i < count; ++i, values += 4) {
+            float x = float(values[0]);
+            float y = float(values[1]);
+            const float z = float(values[2]) - std::abs(x) - std::abs(y);
+            // The lower half is folded over the upper one.
+            const float t = std::min(z, 0.0f);
+            x += x >= 0.0f ? t : -t;
+            y += y >= 0.0f ? t : -t;
+            const float scale = one / std::sqrt(x * x + y * y + z * z);
+            values[0] = T(rounded(x * scale));
+            values[1] = T(rounded(y * scale));
+            values[2] = T(rounded(z * scale));
+          }
+        };
+        if(stride == 4) {
+          decode(reinterpret_cast<int8_t*>(data));
+        } else {
+          decode(reinterpret_cast<int16_t*>(data));
+        }
+        return true;
+      }
+
+      // Three smallest components and which one was dropped, w rebuilt from the unit length.
+      case Meshopt_Filter::Quaternion: {
+        if(stride != 8) return false;
+        int16_t* values = reinterpret_cast<int16_t*>(data);
+        const float range = 1.0f / std::sqrt(2.0f);
+        for(size_t i = 0; i < count; ++i, values += 4) {
+          // The scale the encoder used sits in the top bits of the fourth value.
+          const float scale = range / float(values[3] | 3);
+          const float x = float(values[0]) * scale;
+          const float y = float(values[1]) * scale;
+          const float z = float(values[2]) * scale;
+          const float w = std::sqrt(std::max(1.0f - x * x - y * y - z * z, 0.0f));
+          const int dropped = values[3] & 3;
+          values[(dropped + 1) & 3] = int16_t(rounded(x * 32767.0f));
+          values[(dropped + 2) & 3] = int16_t(rounded(y * 32767.0f));
+          values[(dropped + 3) & 3] = int16_t(rounded(z * 32767.0f));
+          values[dropped] = int16_t(rounded(w * 32767.0f));
+        }
+        return true;
+      }
+
+      // 24 bit mantissa and 8 bit exponent per float.
+      case Meshopt_Filter::Exponential: {
+        if(stride % 4 != 0) return false;
+        for(size_t i = 0; i < count * stride / 4; ++i) {
+          uint32_t bits;
+          std::memcpy(&bits, data + i * 4, 4);
+          const int mantissa = int(bits << 8) >> 8;
+          const int exponent = int(bits) >> 24;
+          const float value = std::ldexp(float(mantissa), exponent);
+          std::memcpy(data + i * 4, &value, 4);
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+};
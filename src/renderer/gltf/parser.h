@@ -0,0 +1,900 @@
+#pragma once
+#include "../gl.h"
+
+#include <glm/gtx/matrix_decompose.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "common.h"
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <bit>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define GLTF_PARSER_SSE2 1
+#endif
+
+// Reads glTF JSON straight into a gltf::Asset. There is no DOM in between: every value is
+// parsed where it is found, and object keys are matched by hash instead of by string.
+
+namespace gltf {
+
+  // FNV-1a.
+  constexpr uint64_t hash_key(std::string_view key) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(char c : key) {
+      hash ^= uint8_t(c);
+      hash *= 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  constexpr uint64_t operator""_key(const char* key, size_t length) {
+    return hash_key({key, length});
+  }
+
+  // The glTF node transform, split up the way Node stores it.
+  inline void set_node_transform(Node& node, const double* translation, const double* rotation, const double* scale, const double* matrix) {
+    glm::mat4 translation_mat4(1.0f);
+    glm::mat4 rotation_mat4(1.0f);
+    glm::mat4 scale_mat4(1.0f);
+
+    if(translation) {
+      translation_mat4[3][0] = float(translation[0]);
+      translation_mat4[3][1] = float(translation[1]);
+      translation_mat4[3][2] = float(translation[2]);
+    }
+
+    if(rotation) {
+      // glTF Quat = (x, y, z, w)
+      // glm Quat constructor = (w, x, y, z)
+      glm::quat tmp_quat(static_cast<float>(rotation[3]), static_cast<float>(rotation[0]), static_cast<float>(rotation[1]), static_cast<float>(rotation[2]));
+      rotation_mat4 = glm::mat4_cast(tmp_quat);
+    }
+
+    if(scale) {
+      scale_mat4[0][0] = float(scale[0]);
+      scale_mat4[1][1] = float(scale[1]);
+      scale_mat4[2][2] = float(scale[2]);
+    }
+
+    if(matrix) {
+      float matrix_f32[16];
+      for(int i = 0; i < 16; ++i) matrix_f32[i] = float(matrix[i]);
+      glm::mat4 gltf_matrix = glm::make_mat4(&matrix_f32[0]);
+
+      glm::quat rot{};
+      glm::vec3 decomposed_scale{}, skew{}, decomposed_translation{};
+      glm::vec4 perpsective;
+      glm::decompose(gltf_matrix, decomposed_scale, rot, decomposed_translation, skew, perpsective);
+
+      translation_mat4[3][0] = decomposed_translation[0];
+      translation_mat4[3][1] = decomposed_translation[1];
+      translation_mat4[3][2] = decomposed_translation[2];
+      rotation_mat4 = glm::mat4_cast(rot);
+      scale_mat4[0][0] = decomposed_scale[0];
+      scale_mat4[1][1] = decomposed_scale[1];
+      scale_mat4[2][2] = decomposed_scale[2];
+    }
+
+    node.translation = translation_mat4;
+    node.rotation = rotation_mat4;
+    node.scale = scale_mat4;
+  }
+
+  class Parser {
+  public:
+    // Appends everything in json to asset. On failure error describes the first problem.
+    static bool parse(std::string_view json, Asset& asset, std::string& error) {
+      Parser parser(json, asset);
+      bool ok = parser.parse_root();
+      if(!ok) error = parser.error;
+      return ok && validate_indices(asset, error);
+    }
+
+    // Every index the loader and renderer follow points at something, once, so nothing after this
+    // has to check. Nodes form trees below the scenes, which keeps their traversal finite.
+    static bool validate_indices(const Asset& asset, std::string& error) {
+      auto check = [&error](int index, size_t size, bool optional, const char* what, size_t owner, const char* property) {
+        if((optional && index == -1) || (index >= 0 && size_t(index) < size)) return true;
+        error = std::string(what) + " " + std::to_string(owner) + " has an out of range " + property + " index " + std::to_string(index);
+        return false;
+      };
+
+      if(!check(asset.default_scene, asset.scenes.size(), true, "the asset", 0, "scene")) return false;
+
+      std::vector<int> parents(asset.nodes.size());
+      for(size_t node_index = 0; node_index < asset.nodes.size(); ++node_index) {
+        const auto& node = asset.nodes[node_index];
+        if(!check(node.mesh, asset.meshes.size(), true, "node", node_index, "mesh")) return false;
+        for(Node_Handle child : node.children) {
+          if(!check(child, asset.nodes.size(), false, "node", node_index, "child")) return false;
+          if(++parents[child] > 1) {
+            error = "node " + std::to_string(child) + " has more than one parent";
+            return false;
+          }
+        }
+      }
+      for(size_t scene_index = 0; scene_index < asset.scenes.size(); ++scene_index) {
+        for(Node_Handle node : asset.scenes[scene_index].nodes) {
+          if(!check(node, asset.nodes.size(), false, "scene", scene_index, "node")) return false;
+          if(parents[node] != 0) {
+            error = "scene " + std::to_string(scene_index) + " lists node " + std::to_string(node) + ", which is not a root node";
+            return false;
+          }
+        }
+      }
+
+      for(size_t mesh_index = 0; mesh_index < asset.meshes.size(); ++mesh_index) {
+        for(const auto& primitive : asset.meshes[mesh_index].primitives) {
+          for(Accessor_Handle attribute : primitive.attributes) {
+            if(!check(attribute, asset.accessors.size(), true, "mesh", mesh_index, "attribute accessor")) return false;
+          }
+          if(!check(primitive.indices, asset.accessors.size(), true, "mesh", mesh_index, "indices accessor") ||
+             !check(primitive.material, asset.materials.size(), true, "mesh", mesh_index, "material") ||
+             !check(primitive.draco_buffer_view, asset.buffer_views.size(), true, "mesh", mesh_index, "Draco bufferView")) return false;
+        }
+      }
+
+      for(size_t accessor_index = 0; accessor_index < asset.accessors.size(); ++accessor_index) {
+        if(!check(asset.accessors[accessor_index].buffer_view, asset.buffer_views.size(), true, "accessor", accessor_index, "bufferView")) return false;
+      }
+      for(size_t buffer_view_index = 0; buffer_view_index < asset.buffer_views.size(); ++buffer_view_index) {
+        const auto& buffer_view = asset.buffer_views[buffer_view_index];
+        if(!check(buffer_view.buffer, asset.buffers.size(), false, "bufferView", buffer_view_index, "buffer")) return false;
+        if(buffer_view.compression.mode != Meshopt_Mode::None &&
+           !check(buffer_view.compression.buffer, asset.buffers.size(), false, "bufferView", buffer_view_index, "meshopt buffer")) return false;
+      }
+      for(size_t material_index = 0; material_index < asset.materials.size(); ++material_index) {
+        if(!check(asset.materials[material_index].base_texture, asset.textures.size(), true, "material", material_index, "baseColorTexture")) return false;
+      }
+      for(size_t texture_index = 0; texture_index < asset.textures.size(); ++texture_index) {
+        const auto& texture = asset.textures[texture_index];
+        if(!check(texture.source, asset.images.size(), true, "texture", texture_index, "source") ||
+           !check(texture.sampler, asset.samplers.size(), true, "texture", texture_index, "sampler")) return false;
+      }
+      for(size_t image_index = 0; image_index < asset.images.size(); ++image_index) {
+        if(!check(asset.images[image_index].buffer_view, asset.buffer_views.size(), true, "image", image_index, "bufferView")) return false;
+      }
+
+      for(size_t animation_index = 0; animation_index < asset.animations.size(); ++animation_index) {
+        const auto& animation = asset.animations[animation_index];
+        for(const auto& sampler : animation.samplers) {
+          if(!check(sampler.input, asset.accessors.size(), false, "animation", animation_index, "sampler input") ||
+             !check(sampler.output, asset.accessors.size(), false, "animation", animation_index, "sampler output")) return false;
+        }
+        // A channel without a node targets something an extension defines, and is not played.
+        for(const auto& channel : animation.channels) {
+          if(!check(channel.sampler, animation.samplers.size(), false, "animation", animation_index, "channel sampler") ||
+             !check(channel.target_node, asset.nodes.size(), true, "animation", animation_index, "channel node")) return false;
+        }
+      }
+      return true;
+    }
+
+  private:
+    const char* begin;
+    const char* cursor;
+    const char* end;
+    Asset& asset;
+    std::string error{};
+    // Unescaped copy of the current key, only used when a key contains escapes.
+    std::string scratch{};
+
+    Parser(std::string_view json, Asset& asset) : begin(json.data()), cursor(json.data()), end(json.data() + json.size()), asset(asset) {}
+
+    bool fail(std::string_view message) {
+      if(error.empty()) {
+        error = std::string(message) + " (at byte " + std::to_string(cursor - begin) + ")";
+      }
+      return false;
+    }
+
+    // --- Scanning -------------------------------------------------------------------------
+
+    static bool is_whitespace(char c) {
+      return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    void skip_whitespace() {
+#ifdef GLTF_PARSER_SSE2
+      // Pretty printed files spend a lot of bytes on indentation.
+      while(end - cursor >= 16 && is_whitespace(*cursor)) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+        __m128i other = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')));
+        unsigned mask = ~unsigned(_mm_movemask_epi8(_mm_or_si128(space, other))) & 0xFFFF;
+        if(mask != 0) {
+          cursor += std::countr_zero(mask);
+          return;
+        }
+        cursor += 16;
+      }
+#endif
+      while(cursor < end && is_whitespace(*cursor)) ++cursor;
+    }
+
+    // Moves the cursor to the next '"' or '\\'.
+    void scan_string_body() {
+#ifdef GLTF_PARSER_SSE2
+      // Strings can be huge: data: URIs embed whole buffers and images.
+      while(end - cursor >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+        __m128i quote = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'));
+        __m128i backslash = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'));
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_or_si128(quote, backslash)));
+        if(mask != 0) {
+          cursor += std::countr_zero(mask);
+          return;
+        }
+        cursor += 16;
+      }
+#endif
+      while(cursor < end && *cursor != '"' && *cursor != '\\') ++cursor;
+    }
+
+    bool consume(char c) {
+      skip_whitespace();
+      if(cursor < end && *cursor == c) {
+        ++cursor;
+        return true;
+      }
+      return false;
+    }
+
+    bool expect(char c) {
+      if(consume(c)) return true;
+      return fail(std::string("Expected '") + c + "'");
+    }
+
+    // Reads a string token. raw is the text between the quotes, escapes are left untouched.
+    bool parse_raw_string(std::string_view& raw, bool& has_escapes) {
+      if(!expect('"')) return false;
+      const char* start = cursor;
+      has_escapes = false;
+      for(;;) {
+        scan_string_body();
+        if(cursor >= end) return fail("Unterminated string");
+        if(*cursor == '"') break;
+        // Skip the escaped character, which may itself be a quote.
+        has_escapes = true;
+        cursor += 2;
+      }
+      raw = std::string_view(start, size_t(cursor - start));
+      ++cursor;
+      return true;
+    }
+
+    static void append_utf8(std::string& out, uint32_t code_point) {
+      if(code_point < 0x80) {
+        out += char(code_point);
+      } else if(code_point < 0x800) {
+        out += char(0xC0 | (code_point >> 6));
+        out += char(0x80 | (code_point & 0x3F));
+      } else if(code_point < 0x10000) {
+        out += char(0xE0 | (code_point >> 12));
+        out += char(0x80 | ((code_point >> 6) & 0x3F));
+        out += char(0x80 | (code_point & 0x3F));
+      } else {
+        out += char(0xF0 | (code_point >> 18));
+        out += char(0x80 | ((code_point >> 12) & 0x3F));
+        out += char(0x80 | ((code_point >> 6) & 0x3F));
+        out += char(0x80 | (code_point & 0x3F));
+      }
+    }
+
+    static bool parse_hex4(std::string_view raw, size_t at, uint32_t& value) {
+      if(at + 4 > raw.size()) return false;
+      auto result = std::from_chars(raw.data() + at, raw.data() + at + 4, value, 16);
+      return result.ec == std::errc() && result.ptr == raw.data() + at + 4;
+    }
+
+    bool unescape(std::string_view raw, std::string& out) {
+      out.clear();
+      out.reserve(raw.size());
+      for(size_t i = 0; i < raw.size(); ++i) {
+        if(raw[i] != '\\') {
+          out += raw[i];
+          continue;
+        }
+        if(++i >= raw.size()) return fail("Bad escape sequence");
+        switch (raw[i]) {
+          case '"':  out += '"';  break;
+          case '\\': out += '\\'; break;
+          case '/':  out += '/';  break;
+          case 'b':  out += '\b'; break;
+          case 'f':  out += '\f'; break;
+          case 'n':  out += '\n'; break;
+          case 'r':  out += '\r'; break;
+          case 't':  out += '\t'; break;
+          case 'u': {
+            uint32_t code_point{};
+            if(!parse_hex4(raw, i + 1, code_point)) return fail("Bad \\u escape");
+            i += 4;
+            // Surrogate pair.
+            if(code_point >= 0xD800 && code_point < 0xDC00 && i + 6 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u') {
+              uint32_t low{};
+              if(parse_hex4(raw, i + 3, low) && low >= 0xDC00 && low < 0xE000) {
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                i += 6;
+              }
+            }
+            append_utf8(out, code_point);
+            break;
+          }
+          default: return fail("Bad escape sequence");
+        }
+      }
+      return true;
+    }
+
+    bool parse_string(std::string& out) {
+      std::string_view raw;
+      bool has_escapes;
+      if(!parse_raw_string(raw, has_escapes)) return false;
+      if(!has_escapes) {
+        out.assign(raw);
+        return true;
+      }
+      return unescape(raw, out);
+    }
+
+    // Data URIs can be hundreds of MB of base64. Unless escapes force a copy, only the prefix is
+    // copied and the payload is left in the JSON for the decoder to read in place.
+    bool parse_uri(std::string& uri, std::string_view& embedded) {
+      std::string_view raw;
+      bool has_escapes;
+      if(!parse_raw_string(raw, has_escapes)) return false;
+      if(has_escapes) {
+        embedded = {};
+        return unescape(raw, uri);
+      }
+
+      auto comma = raw.find(',');
+      if(raw.starts_with("data:") && comma != std::string_view::npos) {
+        uri.assign(raw.substr(0, comma + 1));
+        embedded = raw.substr(comma + 1);
+      } else {
+        uri.assign(raw);
+        embedded = {};
+      }
+      return true;
+    }
+
+    // Parses a string and returns its hash. Used for keys and enum-like string values.
+    bool parse_hashed_string(uint64_t& hash) {
+      std::string_view raw;
+      bool has_escapes;
+      if(!parse_raw_string(raw, has_escapes)) return false;
+      if(has_escapes) {
+        if(!unescape(raw, scratch)) return false;
+        raw = scratch;
+      }
+      hash = hash_key(raw);
+      return true;
+    }
+
+    template<typename T>
+    bool parse_integer(T& value) {
+      skip_whitespace();
+      auto result = std::from_chars(cursor, end, value);
+      if(result.ec == std::errc() && (result.ptr == end || (*result.ptr != '.' && *result.ptr != 'e' && *result.ptr != 'E'))) {
+        cursor = result.ptr;
+        return true;
+      }
+
+      // Some exporters write integers as 1.0 or 1e2.
+      double real{};
+      auto real_result = std::from_chars(cursor, end, real);
+      if(real_result.ec != std::errc() || real != double(T(real))) return fail("Expected an integer");
+      value = T(real);
+      cursor = real_result.ptr;
+      return true;
+    }
+
+    bool parse_number(double& value) {
+      skip_whitespace();
+      auto result = std::from_chars(cursor, end, value);
+      if(result.ec != std::errc()) return fail("Expected a number");
+      cursor = result.ptr;
+      return true;
+    }
+
+    bool parse_float(float& value) {
+      double number{};
+      if(!parse_number(number)) return false;
+      value = float(number);
+      return true;
+    }
+
+    bool parse_bool(bool& value) {
+      skip_whitespace();
+      if(end - cursor >= 4 && std::memcmp(cursor, "true", 4) == 0) {
+        value = true;
+        cursor += 4;
+        return true;
+      }
+      if(end - cursor >= 5 && std::memcmp(cursor, "false", 5) == 0) {
+        value = false;
+        cursor += 5;
+        return true;
+      }
+      return fail("Expected a boolean");
+    }
+
+    // Calls on_key(hash) for each key, which has to consume the value.
+    template<typename F>
+    bool parse_object(F&& on_key) {
+      if(!expect('{')) return false;
+      if(consume('}')) return true;
+      do {
+        uint64_t key{};
+        skip_whitespace();
+        if(!parse_hashed_string(key)) return false;
+        if(!expect(':')) return false;
+        if(!on_key(key)) return false;
+      } while(consume(','));
+      return expect('}');
+    }
+
+    // Calls on_element(index) for each element, which has to consume the value.
+    template<typename F>
+    bool parse_array(F&& on_element) {
+      if(!expect('[')) return false;
+      if(consume(']')) return true;
+      int index = 0;
+      do {
+        if(!on_element(index++)) return false;
+      } while(consume(','));
+      return expect(']');
+    }
+
+    // Fills up to capacity numbers and returns how many there were.
+    bool parse_numbers(double* out, int capacity, int& count) {
+      count = 0;
+      return parse_array([&](int index) {
+        double value{};
+        if(!parse_number(value)) return false;
+        if(index < capacity) out[index] = value;
+        count = index + 1;
+        return true;
+      });
+    }
+
+    bool parse_integers(std::vector<int>& out) {
+      return parse_array([&](int) {
+        int value{};
+        if(!parse_integer(value)) return false;
+        out.push_back(value);
+        return true;
+      });
+    }
+
+    bool skip_value() {
+      skip_whitespace();
+      if(cursor >= end) return fail("Unexpected end of file");
+      if(*cursor == ',' || *cursor == ':' || *cursor == '}' || *cursor == ']') return fail("Expected a value");
+
+      int depth = 0;
+      do {
+        skip_whitespace();
+        if(cursor >= end) return fail("Unexpected end of file");
+        switch (*cursor) {
+          case '{': case '[': ++depth; ++cursor; break;
+          case '}': case ']': --depth; ++cursor; break;
+          case ',': case ':': ++cursor; break;
+          case '"': {
+            std::string_view raw;
+            bool has_escapes;
+            if(!parse_raw_string(raw, has_escapes)) return false;
+            break;
+          }
+          default: {
+            // Number or literal.
+            while(cursor < end && !is_whitespace(*cursor) && *cursor != ',' && *cursor != '}' && *cursor != ']') ++cursor;
+          }
+        }
+      } while(depth > 0);
+      return true;
+    }
+
+    // --- glTF -----------------------------------------------------------------------------
+
+    bool parse_root() {
+      bool ok = parse_object([&](uint64_t key) {
+        switch (key) {
+          case "scene"_key:               return parse_integer(asset.default_scene);
+          case "scenes"_key:              return parse_array([&](int) { return parse_scene(asset.scenes.emplace_back()); });
+          case "nodes"_key:               return parse_array([&](int) { return parse_node(asset.nodes.emplace_back()); });
+          case "meshes"_key:              return parse_array([&](int) { return parse_mesh(asset.meshes.emplace_back()); });
+          case "accessors"_key:           return parse_array([&](int) { return parse_accessor(asset.accessors.emplace_back()); });
+          case "bufferViews"_key:         return parse_array([&](int) { return parse_buffer_view(asset.buffer_views.emplace_back()); });
+          case "buffers"_key:             return parse_array([&](int) { return parse_buffer(asset.buffers.emplace_back()); });
+          case "materials"_key:           return parse_array([&](int) { return parse_material(asset.materials.emplace_back()); });
+          case "textures"_key:            return parse_array([&](int) { return parse_texture(asset.textures.emplace_back()); });
+          case "samplers"_key:            return parse_array([&](int) { return parse_sampler(asset.samplers.emplace_back()); });
+          case "images"_key:              return parse_array([&](int) { return parse_image(asset.images.emplace_back()); });
+          case "animations"_key:          return parse_array([&](int) { return parse_animation(asset.animations.emplace_back()); });
+          case "extensionsRequired"_key:  return parse_array([&](int) { return parse_string(asset.extensions_required.emplace_back()); });
+          default:                        return skip_value();
+        }
+      });
+      if(!ok) return false;
+
+      skip_whitespace();
+      if(cursor != end && *cursor != '\0') return fail("Trailing characters after the root object");
+      return true;
+    }
+
+    bool parse_scene(Scene& scene) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "name"_key:  return parse_string(scene.name);
+          case "nodes"_key: return parse_integers(scene.nodes);
+          default:          return skip_value();
+        }
+      });
+    }
+
+    bool parse_node(Node& node) {
+      double translation[3], rotation[4], scale[3], matrix[16];
+      bool has_translation = false, has_rotation = false, has_scale = false, has_matrix = false;
+      int count{};
+
+      bool ok = parse_object([&](uint64_t key) {
+        switch (key) {
+          case "name"_key:        return parse_string(node.name);
+          case "mesh"_key:        return parse_integer(node.mesh);
+          case "children"_key:    return parse_integers(node.children);
+          case "translation"_key: has_translation = true; return parse_numbers(translation, 3, count) && (count == 3 || fail("translation needs 3 values"));
+          case "rotation"_key:    has_rotation = true;    return parse_numbers(rotation, 4, count) && (count == 4 || fail("rotation needs 4 values"));
+          case "scale"_key:       has_scale = true;       return parse_numbers(scale, 3, count) && (count == 3 || fail("scale needs 3 values"));
+          case "matrix"_key:      has_matrix = true;      return parse_numbers(matrix, 16, count) && (count == 16 || fail("matrix needs 16 values"));
+          default:                return skip_value();
+        }
+      });
+      if(!ok) return false;
+
+      set_node_transform(node,
+                         has_translation ? translation : nullptr,
+                         has_rotation ? rotation : nullptr,
+                         has_scale ? scale : nullptr,
+                         has_matrix ? matrix : nullptr);
+      return true;
+    }
+
+    bool parse_mesh(Mesh& mesh) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "name"_key:       return parse_string(mesh.name);
+          case "primitives"_key: return parse_array([&](int) { return parse_primitive(mesh.primitives.emplace_back()); });
+          default:               return skip_value();
+        }
+      });
+    }
+
+    bool parse_primitive(Primitive& primitive) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "attributes"_key: {
+            return parse_object([&](uint64_t attribute) {
+              int accessor{};
+              if(!parse_integer(accessor)) return false;
+              if(const int slot = attribute_slot(attribute); slot != -1) primitive.attributes[slot] = accessor;
+              return true;
+            });
+          }
+          case "extensions"_key: {
+            return parse_object([&](uint64_t extension) {
+              switch (extension) {
+                case "KHR_draco_mesh_compression"_key: return parse_draco_compression(primitive);
+                default:                               return skip_value();
+              }
+            });
+          }
+          case "indices"_key:  return parse_integer(primitive.indices);
+          case "material"_key: return parse_integer(primitive.material);
+          case "mode"_key: {
+            int mode{};
+            if(!parse_integer(mode)) return false;
+            primitive.mode = static_cast<Primitive_Mode>(mode);
+            return true;
+          }
+          default: return skip_value();
+        }
+      });
+    }
+
+    static int attribute_slot(uint64_t attribute) {
+      switch (attribute) {
+        case "POSITION"_key:   return Position;
+        case "NORMAL"_key:     return Normal;
+        case "TEXCOORD_0"_key: return Texcoord_0;
+        case "JOINTS_0"_key:   return Joints_0;
+        case "WEIGHTS_0"_key:  return Weights_0;
+      }
+      return -1;
+    }
+
+    bool parse_draco_compression(Primitive& primitive) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "bufferView"_key: return parse_integer(primitive.draco_buffer_view);
+          case "attributes"_key: {
+            return parse_object([&](uint64_t attribute) {
+              int id{};
+              if(!parse_integer(id)) return false;
+              if(const int slot = attribute_slot(attribute); slot != -1) primitive.draco_attributes[slot] = id;
+              return true;
+            });
+          }
+          default: return skip_value();
+        }
+      });
+    }
+
+    bool parse_accessor(Accessor& accessor) {
+      int min_count = 0, max_count = 0;
+      bool sparse = false;
+      bool ok = parse_object([&](uint64_t key) {
+        switch (key) {
+          case "bufferView"_key:    return parse_integer(accessor.buffer_view);
+          case "byteOffset"_key:    return parse_integer(accessor.byte_offset);
+          case "componentType"_key: return parse_integer(accessor.component_type);
+          case "normalized"_key:    return parse_bool(accessor.normalized);
+          case "count"_key:         return parse_integer(accessor.count);
+          case "min"_key:           return parse_numbers(accessor.min.data(), int(accessor.min.size()), min_count);
+          case "max"_key:           return parse_numbers(accessor.max.data(), int(accessor.max.size()), max_count);
+          case "type"_key: {
+            uint64_t type{};
+            if(!parse_hashed_string(type)) return false;
+            switch (type) {
+              case "SCALAR"_key: accessor.type = Accessor_Type::Scalar; break;
+              case "VEC2"_key:   accessor.type = Accessor_Type::Vec2;   break;
+              case "VEC3"_key:   accessor.type = Accessor_Type::Vec3;   break;
+              case "VEC4"_key:   accessor.type = Accessor_Type::Vec4;   break;
+              case "MAT2"_key:   accessor.type = Accessor_Type::Mat2;   break;
+              case "MAT3"_key:   accessor.type = Accessor_Type::Mat3;   break;
+              case "MAT4"_key:   accessor.type = Accessor_Type::Mat4;   break;
+              default: return fail("Unknown accessor type");
+            }
+            return true;
+          }
+          case "sparse"_key:
+            sparse = true;
+            return skip_value();
+          default: return skip_value();
+        }
+      });
+      accessor.has_bounds = min_count > 0 && min_count == max_count;
+      // Its bufferView only holds the values before substitution. Without one the accessor reads as
+      // missing, the same as an accessor with no data at all.
+      if(ok && sparse) {
+        std::cout << "accessor " << asset.accessors.size() - 1 << " uses sparse storage, which is not supported" << std::endl;
+        accessor.buffer_view = Invalid_Buffer_View_Handle;
+      }
+      return ok;
+    }
+
+    bool parse_buffer_view(Buffer_View& buffer_view) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "buffer"_key:     return parse_integer(buffer_view.buffer);
+          case "byteOffset"_key: return parse_integer(buffer_view.byte_offset);
+          case "byteLength"_key: return parse_integer(buffer_view.byte_length);
+          case "byteStride"_key: return parse_integer(buffer_view.byte_stride);
+          case "target"_key:     return parse_integer(buffer_view.target);
+          case "extensions"_key: {
+            return parse_object([&](uint64_t extension) {
+              switch (extension) {
+                case "EXT_meshopt_compression"_key: return parse_meshopt_compression(buffer_view.compression);
+                default:                            return skip_value();
+              }
+            });
+          }
+          default:               return skip_value();
+        }
+      });
+    }
+
+    bool parse_meshopt_compression(Meshopt_Compression& compression) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "buffer"_key:     return parse_integer(compression.buffer);
+          case "byteOffset"_key: return parse_integer(compression.byte_offset);
+          case "byteLength"_key: return parse_integer(compression.byte_length);
+          case "byteStride"_key: return parse_integer(compression.byte_stride);
+          case "count"_key:      return parse_integer(compression.count);
+          case "mode"_key: {
+            uint64_t mode{};
+            if(!parse_hashed_string(mode)) return false;
+            switch (mode) {
+              case "ATTRIBUTES"_key: compression.mode = Meshopt_Mode::Attributes; break;
+              case "TRIANGLES"_key:  compression.mode = Meshopt_Mode::Triangles;  break;
+              case "INDICES"_key:    compression.mode = Meshopt_Mode::Indices;    break;
+              default: return fail("Unknown EXT_meshopt_compression mode");
+            }
+            return true;
+          }
+          case "filter"_key: {
+            uint64_t filter{};
+            if(!parse_hashed_string(filter)) return false;
+            switch (filter) {
+              case "NONE"_key:        compression.filter = Meshopt_Filter::None;        break;
+              case "OCTAHEDRAL"_key:  compression.filter = Meshopt_Filter::Octahedral;  break;
+              case "QUATERNION"_key:  compression.filter = Meshopt_Filter::Quaternion;  break;
+              case "EXPONENTIAL"_key: compression.filter = Meshopt_Filter::Exponential; break;
+              default: return fail("Unknown EXT_meshopt_compression filter");
+            }
+            return true;
+          }
+          default: return skip_value();
+        }
+      });
+    }
+
+    bool parse_buffer(Buffer_Data& buffer) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "uri"_key:        return parse_uri(buffer.uri, buffer.embedded);
+          case "byteLength"_key: return parse_integer(buffer.byte_length);
+          default:               return skip_value();
+        }
+      });
+    }
+
+    bool parse_texture_info(int& texture) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "index"_key: return parse_integer(texture);
+          default:          return skip_value();
+        }
+      });
+    }
+
+    bool parse_material(Material& material) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "pbrMetallicRoughness"_key: {
+            return parse_object([&](uint64_t pbr_key) {
+              switch (pbr_key) {
+                case "baseColorFactor"_key: {
+                  double base_color[4] = {1.0, 1.0, 1.0, 1.0};
+                  int count{};
+                  if(!parse_numbers(base_color, 4, count)) return false;
+                  material.base_color = glm::vec4(float(base_color[0]), float(base_color[1]), float(base_color[2]), float(base_color[3]));
+                  return true;
+                }
+                case "baseColorTexture"_key: return parse_texture_info(material.base_texture);
+                default:                     return skip_value();
+              }
+            });
+          }
+          default: return skip_value();
+        }
+      });
+    }
+
+    bool parse_texture(Texture2D& texture) {
+      int basisu_source = -1;
+      bool ok = parse_object([&](uint64_t key) {
+        switch (key) {
+          case "source"_key:  return parse_integer(texture.source);
+          case "sampler"_key: return parse_integer(texture.sampler);
+          case "extensions"_key: {
+            return parse_object([&](uint64_t extension) {
+              switch (extension) {
+                case "KHR_texture_basisu"_key: {
+                  return parse_object([&](uint64_t basisu_key) {
+                    switch (basisu_key) {
+                      case "source"_key: return parse_integer(basisu_source);
+                      default:           return skip_value();
+                    }
+                  });
+                }
+                default: return skip_value();
+              }
+            });
+          }
+          default:            return skip_value();
+        }
+      });
+      // KHR_texture_basisu: the KTX2 image wins, source is only a fallback for loaders without it.
+      if(basisu_source != -1) texture.source = basisu_source;
+      return ok;
+    }
+
+    bool parse_sampler(Sampler& sampler) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "magFilter"_key: return parse_integer(sampler.mag_filter);
+          case "minFilter"_key: return parse_integer(sampler.min_filter);
+          case "wrapS"_key:     return parse_integer(sampler.wrap_s);
+          case "wrapT"_key:     return parse_integer(sampler.wrap_t);
+          default:              return skip_value();
+        }
+      });
+    }
+
+    bool parse_image(Image& image) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "name"_key:       return parse_string(image.name);
+          case "uri"_key:        return parse_uri(image.uri, image.embedded);
+          case "mimeType"_key:   return parse_string(image.mime_type);
+          case "bufferView"_key: return parse_integer(image.buffer_view);
+          default:               return skip_value();
+        }
+      });
+    }
+
+    bool parse_animation(Animation& animation) {
+      return parse_object([&](uint64_t key) {
+        switch (key) {
+          case "name"_key: return parse_string(animation.name);
+          case "channels"_key: {
+            return parse_array([&](int) {
+              auto& channel = animation.channels.emplace_back();
+              return parse_object([&](uint64_t channel_key) {
+                switch (channel_key) {
+                  case "sampler"_key: return parse_integer(channel.sampler);
+                  case "target"_key: {
+                    return parse_object([&](uint64_t target_key) {
+                      switch (target_key) {
+                        case "node"_key: return parse_integer(channel.target_node);
+                        case "path"_key: {
+                          uint64_t path{};
+                          if(!parse_hashed_string(path)) return false;
+                          switch (path) {
+                            case "translation"_key: channel.target_path = Target_Path::Translation; break;
+                            case "rotation"_key:    channel.target_path = Target_Path::Rotation;    break;
+                            case "scale"_key:       channel.target_path = Target_Path::Scale;       break;
+                            case "weights"_key:     channel.target_path = Target_Path::Weights;     break;
+                            default: return fail("Unknown animation target path");
+                          }
+                          return true;
+                        }
+                        default: return skip_value();
+                      }
+                    });
+                  }
+                  default: return skip_value();
+                }
+              });
+            });
+          }
+          case "samplers"_key: {
+            return parse_array([&](int) {
+              auto& sampler = animation.samplers.emplace_back();
+              return parse_object([&](uint64_t sampler_key) {
+                switch (sampler_key) {
+                  case "input"_key:  return parse_integer(sampler.input);
+                  case "output"_key: return parse_integer(sampler.output);
+                  case "interpolation"_key: {
+                    uint64_t interpolation{};
+                    if(!parse_hashed_string(interpolation)) return false;
+                    switch (interpolation) {
+                      case "LINEAR"_key:      sampler.interpolation = Interpolation::Linear;       break;
+                      case "STEP"_key:        sampler.interpolation = Interpolation::Step;         break;
+                      case "CUBICSPLINE"_key: sampler.interpolation = Interpolation::Cubic_Spline; break;
+                      default: return fail("Unknown interpolation");
+                    }
+                    return true;
+                  }
+                  default: return skip_value();
+                }
+              });
+            });
+          }
+          default: return skip_value();
+        }
+      });
+    }
+  };
+
+};
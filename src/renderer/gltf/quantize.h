@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Encoders for the load-time attribute quantizer, see Loader::Repack_Options::quantize. The
+// matching decoders are the GL vertex fetch (normalized and half float formats) and
+// octahedral_decode() in basic.vs.
+
+namespace gltf {
+
+  inline uint16_t float_to_unorm16(float value) {
+    return uint16_t(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+  }
+
+  inline int16_t float_to_snorm16(float value) {
+    return int16_t(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+  }
+
+  // IEEE half, rounded to nearest even. Too large becomes infinity, too small a subnormal or zero.
+  inline uint16_t float_to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const int exponent = int((bits >> 23) & 0xFF);
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if(exponent == 0xFF) return uint16_t(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+    const int half_exponent = exponent - 127 + 15;
+    if(half_exponent >= 31) return uint16_t(sign | 0x7C00);
+
+    if(half_exponent <= 0) {
+      if(half_exponent < -10) return uint16_t(sign);
+      mantissa |= 0x800000;
+      const int shift = 14 - half_exponent;
+      uint32_t half = mantissa >> shift;
+      const uint32_t rest = mantissa & ((1u << shift) - 1);
+      const uint32_t halfway = 1u << (shift - 1);
+      if(rest > halfway || (rest == halfway && (half & 1))) ++half;
+      return uint16_t(sign | half);
+    }
+
+    uint32_t half = (uint32_t(half_exponent) << 10) | (mantissa >> 13);
+    const uint32_t rest = mantissa & 0x1FFF;
+    // A carry out of the mantissa correctly bumps the exponent, up to infinity.
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1))) ++half;
+    return uint16_t(sign | half);
+  }
+
+  // Unit vector to two snorm16 values: projected onto the octahedron |x| + |y| + |z| = 1, with the
+  // lower half folded over the upper one. 4 bytes instead of 12.
+  inline std::array<int16_t, 2> octahedral_encode(glm::vec3 normal) {
+    const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if(length == 0.0f) return {0, 0};
+    float x = normal.x / length;
+    float y = normal.y / length;
+    if(normal.z < 0.0f) {
+      const float folded_x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+      const float folded_y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+      x = folded_x;
+      y = folded_y;
+    }
+    return {float_to_snorm16(x), float_to_snorm16(y)};
+  }
+
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "../gl.h"
+#include "../content_hash.h"
+#include "common.h"
+#include "file_system.h"
+
+#include <bc7enc.h>
+#include <rgbcx.h>
+
+#include <bit>
+#include <span>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+
+// Load-time BCn encoding of decoded PNG and JPEG images, for assets that can't be re-exported with
+// KTX2. The results land in the same shape as a transcoded KTX2 image: every mip level, ready to
+// upload. A content-addressed disk cache keeps them, so later loads skip decoding and encoding.
+
+namespace gltf {
+
+  // Part of every cache key. Bump when the encoders, their settings or the cache files change.
+  constexpr uint32_t Texture_Encoder_Version = 2;
+
+  namespace texture_encode_detail {
+
+    // rgbcx quality level, 0 to 18. Past 10 the gains are small and the encoding time doubles.
+    constexpr uint32_t Bc1_Level = 10;
+
+    inline void init() {
+      static const bool initialized = [] {
+        rgbcx::init();
+        bc7enc_compress_block_init();
+        return true;
+      }();
+      (void)initialized;
+    }
+
+    // The decoded image as 8 bit RGBA. Grey goes to RGB, grey with alpha to RG for BC5.
+    inline std::vector<unsigned char> to_rgba8(const Image& image) {
+      const size_t pixel_count = size_t(image.width) * image.height;
+      const int bytes = image.bits / 8;
+      std::vector<unsigned char> rgba(pixel_count * 4);
+      for(size_t pixel = 0; pixel < pixel_count; ++pixel) {
+        unsigned char channels[4] = {0, 0, 0, 255};
+        for(int channel = 0; channel < image.component; ++channel) {
+          // The high byte of little-endian 16 bit channels.
+          channels[channel] = image.pixels[(pixel * image.component + channel) * bytes + bytes - 1];
+        }
+        unsigned char* to = rgba.data() + pixel * 4;
+        if(image.component == 1) {
+          to[0] = to[1] = to[2] = channels[0];
+          to[3] = 255;
+        } else {
+          std::memcpy(to, channels, 4);
+        }
+      }
+      return rgba;
+    }
+
+    // 2x2 box filter. Odd sizes repeat the last row or column.
+    inline std::vector<unsigned char> downsample(const std::vector<unsigned char>& rgba, int width, int height) {
+      const int next_width = std::max(width >> 1, 1);
+      const int next_height = std::max(height >> 1, 1);
+      std::vector<unsigned char> next(size_t(next_width) * next_height * 4);
+      for(int y = 0; y < next_height; ++y) {
+        const int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+        for(int x = 0; x < next_width; ++x) {
+          const int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+          for(int channel = 0; channel < 4; ++channel) {
+            const int sum = rgba[(size_t(y0) * width + x0) * 4 + channel] + rgba[(size_t(y0) * width + x1) * 4 + channel] +
+                            rgba[(size_t(y1) * width + x0) * 4 + channel] + rgba[(size_t(y1) * width + x1) * 4 + channel];
+            next[(size_t(y) * next_width + x) * 4 + channel] = static_cast<unsigned char>((sum + 2) / 4);
+          }
+        }
+      }
+      return next;
+    }
+
+    inline void encode_level(const std::vector<unsigned char>& rgba, int width, int height, unsigned int format,
+                             const bc7enc_compress_block_params& bc7_params, unsigned char* destination) {
+      const size_t block_bytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+      unsigned char block[16 * 4];
+      for(int block_y = 0; block_y < (height + 3) / 4; ++block_y) {
+        for(int block_x = 0; block_x < (width + 3) / 4; ++block_x) {
+          // Blocks past the edge repeat the last row or column.
+          for(int y = 0; y < 4; ++y) {
+            for(int x = 0; x < 4; ++x) {
+              const int source_x = std::min(block_x * 4 + x, width - 1);
+              const int source_y = std::min(block_y * 4 + y, height - 1);
+              std::memcpy(block + (y * 4 + x) * 4, rgba.data() + (size_t(source_y) * width + source_x) * 4, 4);
+            }
+          }
+          switch (format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:  rgbcx::encode_bc1(Bc1_Level, destination, block, false, false); break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: rgbcx::encode_bc3(Bc1_Level, destination, block); break;
+            case GL_COMPRESSED_RG_RGTC2:           rgbcx::encode_bc5(destination, block, 0, 1, 4); break;
+            default:                               bc7enc_compress_block(destination, block, &bc7_params); break;
+          }
+          destination += block_bytes;
+        }
+      }
+    }
+
+  };
+
+  // The format encode_texture() picks for image. Grey with alpha is BC5, everything else BC7
+  // with bc7, otherwise BC1 when every pixel is opaque and BC3 when not.
+  inline unsigned int encoded_format(const Image& image, bool bc7) {
+    if(image.component == 2) return GL_COMPRESSED_RG_RGTC2;
+    if(bc7) return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    if(image.component == 4) {
+      const int bytes = image.bits / 8;
+      for(size_t alpha = 3 * bytes + bytes - 1; alpha < image.pixels.size(); alpha += 4 * bytes) {
+        if(image.pixels[alpha] != 255) return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+      }
+    }
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  }
+
+  // Replaces image's decoded pixels with a full mip chain in format, see Image::transcoded_format.
+  inline void encode_texture(Image& image, unsigned int format) {
+    texture_encode_detail::init();
+    bc7enc_compress_block_params bc7_params;
+    bc7enc_compress_block_params_init(&bc7_params);
+
+    const int levels = std::bit_width(unsigned(std::max({image.width, image.height, 1})));
+    size_t total = 0;
+    for(int level = 0; level < levels; ++level) total += transcoded_level_size(format, image.width, image.height, level);
+    std::vector<unsigned char> encoded(total);
+
+    std::vector<unsigned char> rgba = texture_encode_detail::to_rgba8(image);
+    size_t offset = 0;
+    for(int level = 0; level < levels; ++level) {
+      const int width = std::max(image.width >> level, 1);
+      const int height = std::max(image.height >> level, 1);
+      if(level > 0) rgba = texture_encode_detail::downsample(rgba, std::max(image.width >> (level - 1), 1), std::max(image.height >> (level - 1), 1));
+      texture_encode_detail::encode_level(rgba, width, height, format, bc7_params, encoded.data() + offset);
+      offset += transcoded_level_size(format, width, height, 0);
+    }
+
+    image.pixels = std::move(encoded);
+    image.bits = 8;
+    image.transcoded_format = format;
+    image.transcoded_levels = levels;
+  }
+
+  // One file per encoded image: this header, then the levels as Image::pixels holds them.
+  struct Texture_Cache_Header {
+    uint32_t magic;
+    uint32_t version;
+    // content_hash() of the encoded source file.
+    uint64_t source_hash_low;
+    uint64_t source_hash_high;
+    uint64_t source_size;
+    int32_t width;
+    int32_t height;
+    int32_t component;
+    uint32_t format;
+    int32_t levels;
+    uint32_t top_row_first;
+  };
+
+  constexpr uint32_t Texture_Cache_Magic = 0x43584554; // "TEXC"
+
+  // False when path is missing, stale or belongs to other source bytes, image is then untouched.
+  inline bool read_texture_cache(const std::string& path, const Content_Hash& source_hash, size_t source_size, Image& image) {
+    const File_Contents contents = read_whole_file(path);
+    Texture_Cache_Header header{};
+    if(!contents.ok || contents.bytes.size() < sizeof(header)) return false;
+    std::memcpy(&header, contents.bytes.data(), sizeof(header));
+    if(header.magic != Texture_Cache_Magic || header.version != Texture_Encoder_Version || header.source_hash_low != source_hash.low ||
+       header.source_hash_high != source_hash.high || header.source_size != source_size || header.levels < 1 || header.levels > 32) return false;
+
+    size_t total = 0;
+    for(int level = 0; level < header.levels; ++level) total += transcoded_level_size(header.format, header.width, header.height, level);
+    if(contents.bytes.size() - sizeof(header) != total) return false;
+
+    image.width = header.width;
+    image.height = header.height;
+    image.component = header.component;
+    image.bits = 8;
+    image.transcoded_format = header.format;
+    image.transcoded_levels = header.levels;
+    image.top_row_first = header.top_row_first != 0;
+    image.pixels.assign(contents.bytes.begin() + sizeof(header), contents.bytes.end());
+    return true;
+  }
+
+  // Written next to path and renamed into place, so concurrent loads never read half a file.
+  inline bool write_texture_cache(const std::string& path, const Content_Hash& source_hash, size_t source_size, const Image& image) {
+    const Texture_Cache_Header header{Texture_Cache_Magic, Texture_Encoder_Version, source_hash.low, source_hash.high, source_size, image.width, image.height,
+                                      image.component, image.transcoded_format, image.transcoded_levels, image.top_row_first};
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    const std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+    {
+      std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+      file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      file.write(reinterpret_cast<const char*>(image.pixels.data()), std::streamsize(image.pixels.size()));
+      if(!file) {
+        file.close();
+        std::filesystem::remove(temporary, error);
+        return false;
+      }
+    }
+    std::filesystem::rename(temporary, path, error);
+    if(!error) return true;
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+
+};
@@ -0,0 +1,355 @@
+#pragma once
+
+#include "gl.h"
+#include "content_hash.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+typedef int Gpu_Allocation_Handle;
+
+constexpr Gpu_Allocation_Handle Invalid_Gpu_Allocation_Handle = Gpu_Allocation_Handle(-1);
+
+// Hands out ranges of a fixed size span. Free ranges are kept sorted by offset, so a freed range
+// is merged with its neighbours right away and the free list never holds two adjacent ranges.
+class Offset_Allocator {
+
+  size_t capacity{};
+  // offset -> size
+  std::map<size_t, size_t> free_ranges{};
+
+public:
+  explicit Offset_Allocator(size_t capacity = 0) : capacity(capacity) {
+    if(capacity != 0) free_ranges.emplace(0, capacity);
+  }
+
+  // First fit. Returns false when no free range can hold size bytes at the alignment.
+  bool allocate(size_t size, size_t alignment, size_t& offset) {
+    for(auto it = free_ranges.begin(); it != free_ranges.end(); ++it) {
+      const auto [range_offset, range_size] = *it;
+      const size_t range_end = range_offset + range_size;
+      const size_t aligned = (range_offset + alignment - 1) / alignment * alignment;
+      if(aligned > range_end || size > range_end - aligned) continue;
+
+      free_ranges.erase(it);
+      if(aligned > range_offset) free_ranges.emplace(range_offset, aligned - range_offset);
+      if(aligned + size < range_end) free_ranges.emplace(aligned + size, range_end - aligned - size);
+      offset = aligned;
+      return true;
+    }
+    return false;
+  }
+
+  void free(size_t offset, size_t size) {
+    auto next = free_ranges.lower_bound(offset);
+    if(next != free_ranges.end() && offset + size == next->first) {
+      size += next->second;
+      next = free_ranges.erase(next);
+    }
+    if(next != free_ranges.begin()) {
+      auto previous = std::prev(next);
+      if(previous->first + previous->second == offset) {
+        previous->second += size;
+        return;
+      }
+    }
+    free_ranges.emplace_hint(next, offset, size);
+  }
+
+  // Free space that isn't the tail of the span, which only compaction can give back.
+  bool has_holes() const {
+    if(free_ranges.empty()) return false;
+    if(free_ranges.size() > 1) return true;
+    const auto& [offset, size] = *free_ranges.begin();
+    return offset + size != capacity;
+  }
+
+  size_t free_bytes() const {
+    size_t bytes = 0;
+    for(const auto& [offset, size] : free_ranges) bytes += size;
+    return bytes;
+  }
+
+  size_t size() const {
+    return capacity;
+  }
+};
+
+// Vertex and index data of every model in a few large immutable GL buffers (arenas), instead of
+// a buffer object per glTF bufferView. Draws address their data with base vertex and index
+// offsets into an arena, so primitives only need different VAOs when their formats differ.
+//
+// Allocations are handles because compact() moves them: look the placement up again whenever
+// generation() changed. Allocating and writing is safe from the upload thread, compaction only
+// runs on the render thread and never while an upload is in flight.
+//
+// Models sharing a heap also share allocations with equal contents, see share(). Those are
+// reference counted, every find_shared() and retain() needs its own free().
+class Gpu_Heap {
+public:
+  enum class Kind {
+    Vertex,
+    Index,
+  };
+
+  // Where an allocation currently lives. Only valid for the generation() it was read in.
+  struct Placement {
+    uint32_t buffer{};
+    size_t offset{};
+    size_t size{};
+  };
+
+  // Identifies the bytes of an allocation by their digest. Other models only have the key to go by,
+  // a model matching its own bytes compares them as well.
+  struct Content_Key {
+    Kind kind{};
+    size_t size{};
+    size_t alignment{};
+    Content_Hash hash{};
+
+    auto operator<=>(const Content_Key&) const = default;
+  };
+
+  struct Stats {
+    int arenas{};
+    int allocations{};
+    size_t used_bytes{};
+    size_t capacity_bytes{};
+  };
+
+  // Larger allocations get an arena of their own.
+  static constexpr size_t Vertex_Arena_Size = 64 * 1024 * 1024;
+  static constexpr size_t Index_Arena_Size = 16 * 1024 * 1024;
+  static constexpr size_t Upload_Slice_Size = 64 * 1024 * 1024;
+
+  Gpu_Heap() = default;
+  Gpu_Heap(const Gpu_Heap&) = delete;
+  Gpu_Heap& operator=(const Gpu_Heap&) = delete;
+
+  ~Gpu_Heap() {
+    for(auto& arena : arenas) glDeleteBuffers(1, &arena.buffer);
+  }
+
+  Gpu_Allocation_Handle allocate(Kind kind, size_t size, size_t alignment) {
+    std::lock_guard lock(mutex);
+    alignment = std::max<size_t>(alignment, 1);
+
+    size_t offset{};
+    int arena_index = -1;
+    for(int i = 0; i < arenas.size() && arena_index == -1; ++i) {
+      if(arenas[i].kind == kind && arenas[i].allocator.allocate(size, alignment, offset)) arena_index = i;
+    }
+    if(arena_index == -1) {
+      const size_t default_size = kind == Kind::Vertex ? Vertex_Arena_Size : Index_Arena_Size;
+      arena_index = create_arena(kind, std::max(default_size, size + alignment));
+      arenas[arena_index].allocator.allocate(size, alignment, offset);
+    }
+    ++arenas[arena_index].allocations;
+
+    Gpu_Allocation_Handle handle;
+    if(!free_handles.empty()) {
+      handle = free_handles.back();
+      free_handles.pop_back();
+    } else {
+      handle = Gpu_Allocation_Handle(allocations.size());
+      allocations.emplace_back();
+    }
+    allocations[handle] = {arena_index, offset, size, alignment};
+    return handle;
+  }
+
+  static Content_Key content_key(Kind kind, std::span<const unsigned char> bytes, size_t alignment) {
+    return {kind, bytes.size(), std::max<size_t>(alignment, 1), content_hash(bytes)};
+  }
+
+  // A shared allocation with these contents and a reference added for the caller, or Invalid_Gpu_Allocation_Handle.
+  Gpu_Allocation_Handle find_shared(const Content_Key& key) {
+    std::lock_guard lock(mutex);
+    auto it = shared_contents.find(key);
+    if(it == shared_contents.end()) return Invalid_Gpu_Allocation_Handle;
+    ++allocations[it->second].references;
+    return it->second;
+  }
+
+  void retain(Gpu_Allocation_Handle handle) {
+    std::lock_guard lock(mutex);
+    ++allocations[handle].references;
+  }
+
+  // Lets other models find handle by its contents. Only once its bytes are visible to every
+  // context, which for an async load means after its fence. The first allocation shared for a key wins.
+  void share(const Content_Key& key, Gpu_Allocation_Handle handle) {
+    std::lock_guard lock(mutex);
+    auto& allocation = allocations[handle];
+    if(allocation.shared || !shared_contents.emplace(key, handle).second) return;
+    allocation.shared = true;
+    allocation.key = key;
+  }
+
+  // Large writes go in slices so the driver never has to stage all of it at once.
+  void write(Gpu_Allocation_Handle handle, std::span<const unsigned char> bytes) {
+    // Not held while uploading, compaction can't move the allocation during an upload anyway.
+    const Placement target = placement(handle);
+    for(size_t offset = 0; offset < bytes.size() && offset < target.size; offset += Upload_Slice_Size) {
+      auto slice = bytes.subspan(offset, std::min({Upload_Slice_Size, bytes.size() - offset, target.size - offset}));
+      glNamedBufferSubData(target.buffer, GLintptr(target.offset + offset), GLsizeiptr(slice.size()), slice.data());
+    }
+  }
+
+  Placement placement(Gpu_Allocation_Handle handle) const {
+    std::lock_guard lock(mutex);
+    const auto& allocation = allocations[handle];
+    return {arenas[allocation.arena].buffer, allocation.offset, allocation.size};
+  }
+
+  void free(Gpu_Allocation_Handle handle) {
+    std::lock_guard lock(mutex);
+    auto& allocation = allocations[handle];
+    if(--allocation.references > 0) return;
+    if(allocation.shared) shared_contents.erase(allocation.key);
+    auto& arena = arenas[allocation.arena];
+    arena.allocator.free(allocation.offset, allocation.size);
+    --arena.allocations;
+    allocation.arena = -1;
+    free_handles.push_back(handle);
+  }
+
+  // Moves allocations together to close the holes freed ranges left, and gives empty arenas back
+  // to the driver. Deferred until the last upload in flight ended.
+  void compact() {
+    std::lock_guard lock(mutex);
+    if(uploads_in_flight > 0) {
+      compaction_pending = true;
+      return;
+    }
+    compact_locked();
+  }
+
+  // Bumped by every compaction that moved something.
+  uint64_t generation() const {
+    std::lock_guard lock(mutex);
+    return current_generation;
+  }
+
+  // Brackets a model's uploads, from any thread. end_upload() has to come from the render thread
+  // after the uploads are visible there, as it may run a deferred compaction.
+  void begin_upload() {
+    std::lock_guard lock(mutex);
+    ++uploads_in_flight;
+  }
+
+  void end_upload() {
+    std::lock_guard lock(mutex);
+    if(--uploads_in_flight == 0 && compaction_pending) compact_locked();
+  }
+
+  Stats stats() const {
+    std::lock_guard lock(mutex);
+    Stats stats;
+    stats.arenas = int(arenas.size());
+    for(const auto& arena : arenas) {
+      stats.allocations += arena.allocations;
+      stats.capacity_bytes += arena.allocator.size();
+      stats.used_bytes += arena.allocator.size() - arena.allocator.free_bytes();
+    }
+    return stats;
+  }
+
+private:
+  struct Arena {
+    Kind kind{};
+    uint32_t buffer{};
+    Offset_Allocator allocator{};
+    int allocations{};
+  };
+
+  struct Allocation {
+    // -1 for a handle that is free.
+    int arena = -1;
+    size_t offset{};
+    size_t size{};
+    size_t alignment{};
+    int references = 1;
+    bool shared{};
+    Content_Key key{};
+  };
+
+  std::vector<Arena> arenas{};
+  std::vector<Allocation> allocations{};
+  std::vector<Gpu_Allocation_Handle> free_handles{};
+  std::map<Content_Key, Gpu_Allocation_Handle> shared_contents{};
+  mutable std::mutex mutex;
+  uint64_t current_generation{};
+  int uploads_in_flight{};
+  bool compaction_pending{};
+
+  static uint32_t create_buffer(size_t size) {
+    uint32_t buffer{};
+    glCreateBuffers(1, &buffer);
+    // Immutable storage, only ever written with glNamedBufferSubData and glCopyNamedBufferSubData.
+    glNamedBufferStorage(buffer, GLsizeiptr(size), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    return buffer;
+  }
+
+  int create_arena(Kind kind, size_t size) {
+    auto& arena = arenas.emplace_back();
+    arena.kind = kind;
+    arena.buffer = create_buffer(size);
+    arena.allocator = Offset_Allocator(size);
+    return int(arenas.size()) - 1;
+  }
+
+  void compact_locked() {
+    compaction_pending = false;
+    bool moved = false;
+
+    std::vector<int> arena_remap(arenas.size(), -1);
+    std::vector<Arena> kept_arenas;
+    for(int arena_index = 0; arena_index < arenas.size(); ++arena_index) {
+      auto& arena = arenas[arena_index];
+      if(arena.allocations == 0) {
+        glDeleteBuffers(1, &arena.buffer);
+        moved = true;
+        continue;
+      }
+
+      if(arena.allocator.has_holes()) {
+        std::vector<Gpu_Allocation_Handle> live;
+        for(int handle = 0; handle < allocations.size(); ++handle) {
+          if(allocations[handle].arena == arena_index) live.push_back(handle);
+        }
+        std::sort(live.begin(), live.end(), [&](auto a, auto b) { return allocations[a].offset < allocations[b].offset; });
+
+        // Ranges of one buffer may not overlap in glCopyNamedBufferSubData, so everything moves into a fresh buffer.
+        const uint32_t compacted = create_buffer(arena.allocator.size());
+        Offset_Allocator allocator(arena.allocator.size());
+        for(auto handle : live) {
+          auto& allocation = allocations[handle];
+          size_t offset{};
+          allocator.allocate(allocation.size, allocation.alignment, offset);
+          glCopyNamedBufferSubData(arena.buffer, compacted, GLintptr(allocation.offset), GLintptr(offset), GLsizeiptr(allocation.size));
+          allocation.offset = offset;
+        }
+        glDeleteBuffers(1, &arena.buffer);
+        arena.buffer = compacted;
+        arena.allocator = std::move(allocator);
+        moved = true;
+      }
+
+      arena_remap[arena_index] = int(kept_arenas.size());
+      kept_arenas.push_back(std::move(arena));
+    }
+
+    arenas = std::move(kept_arenas);
+    for(auto& allocation : allocations) {
+      if(allocation.arena != -1) allocation.arena = arena_remap[allocation.arena];
+    }
+    if(moved) ++current_generation;
+  }
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Unbounded queue for exactly one producer thread and one consumer thread. Neither side ever
+// takes a lock, so a busy producer can't stall the consumer's frame.
+template<typename T>
+class Spsc_Queue {
+
+  struct Node {
+    T value{};
+    std::atomic<Node*> next{nullptr};
+  };
+
+  // head is an already consumed node, the items follow it. Only the consumer touches head,
+  // only the producer touches tail.
+  Node* head;
+  Node* tail;
+
+public:
+  Spsc_Queue() {
+    head = tail = new Node;
+  }
+
+  Spsc_Queue(const Spsc_Queue&) = delete;
+  Spsc_Queue& operator=(const Spsc_Queue&) = delete;
+
+  ~Spsc_Queue() {
+    while(head) {
+      Node* next = head->next.load(std::memory_order_relaxed);
+      delete head;
+      head = next;
+    }
+  }
+
+  // Producer.
+  void push(T value) {
+    Node* node = new Node;
+    node->value = std::move(value);
+    tail->next.store(node, std::memory_order_release);
+    tail = node;
+  }
+
+  // Consumer. The oldest item, or nullptr when empty. Stays valid until pop().
+  T* front() {
+    Node* next = head->next.load(std::memory_order_acquire);
+    return next ? &next->value : nullptr;
+  }
+
+  // Consumer. Only valid after front() returned an item.
+  void pop() {
+    Node* next = head->next.load(std::memory_order_acquire);
+    delete head;
+    head = next;
+  }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+
+// A one-shot DAG of jobs. Worker tasks run on a Thread_Pool, Main tasks run on the thread that
+// calls run() (the one owning the GL context). A task starts as soon as all of its
+// dependencies are done, so independent chains overlap.
+class Task_Graph {
+public:
+  using Task_Id = int;
+
+  enum class Affinity {
+    Worker,
+    Main,
+  };
+
+  // Dependencies have to be added before the tasks that need them, which keeps ids in topological order.
+  Task_Id add(std::string name, Affinity affinity, std::function<void()> work, std::span<const Task_Id> dependencies = {}) {
+    Task_Id id = Task_Id(tasks.size());
+    auto& task = tasks.emplace_back();
+    task.name = std::move(name);
+    task.affinity = affinity;
+    task.work = std::move(work);
+    task.dependencies.assign(dependencies.begin(), dependencies.end());
+    for(Task_Id dependency : dependencies) tasks[dependency].dependents.push_back(id);
+    return id;
+  }
+
+  Task_Id add(std::string name, Affinity affinity, std::function<void()> work, std::initializer_list<Task_Id> dependencies) {
+    return add(std::move(name), affinity, std::move(work), std::span<const Task_Id>(dependencies.begin(), dependencies.size()));
+  }
+
+  // A task without work that finishes when complete() is called, from any thread. Lets I/O that
+  // happens outside the pool take part in the graph. Timed from the start of run().
+  Task_Id add_external(std::string name, std::span<const Task_Id> dependencies = {}) {
+    Task_Id id = add(std::move(name), Affinity::Worker, {}, dependencies);
+    tasks[id].external = true;
+    return id;
+  }
+
+  // May be called before the task's own dependencies are done, it then waits for them.
+  void complete(Task_Id id) {
+    if(--remaining_dependencies[id] == 0) dispatch(id);
+  }
+
+  size_t size() const {
+    return tasks.size();
+  }
+
+  // Blocks until every task ran. Main tasks are executed here while waiting.
+  void run(Thread_Pool& pool) {
+    if(tasks.empty()) return;
+
+    this->pool = &pool;
+    remaining_dependencies = std::make_unique<std::atomic<int>[]>(tasks.size());
+    finished = 0;
+    start = Clock::now();
+
+    // The completion of an external task counts as one more dependency.
+    for(size_t i = 0; i < tasks.size(); ++i) remaining_dependencies[i] = int(tasks[i].dependencies.size()) + (tasks[i].external ? 1 : 0);
+    for(size_t i = 0; i < tasks.size(); ++i) {
+      if(tasks[i].dependencies.empty() && !tasks[i].external) dispatch(Task_Id(i));
+    }
+
+    // Returning frees the graph, so only once nothing touches it anymore: after the main thread
+    // ran the last task itself, or popped the Wake_Up the last worker task pushes.
+    for(;;) {
+      Task_Id id = main_queue.pop();
+      if(id == Wake_Up || execute(id)) break;
+    }
+
+    wall_milliseconds = milliseconds_since_start();
+  }
+
+  // The longest dependency chain bounds how fast the graph can possibly finish.
+  void print_report(const char* title) const {
+    std::vector<double> chain(tasks.size());
+    std::vector<Task_Id> previous(tasks.size(), -1);
+    Task_Id last = -1;
+    for(size_t i = 0; i < tasks.size(); ++i) {
+      double longest_dependency = 0.0;
+      for(Task_Id dependency : tasks[i].dependencies) {
+        if(chain[dependency] > longest_dependency) {
+          longest_dependency = chain[dependency];
+          previous[i] = dependency;
+        }
+      }
+      chain[i] = longest_dependency + (tasks[i].end - tasks[i].begin);
+      if(last == -1 || chain[i] > chain[last]) last = Task_Id(i);
+    }
+
+    double busy = 0.0;
+    for(const auto& task : tasks) busy += task.end - task.begin;
+
+    std::cout << title << ": " << tasks.size() << " tasks in " << wall_milliseconds << " ms wall time, "
+              << busy << " ms of work, critical path " << (last == -1 ? 0.0 : chain[last]) << " ms:" << std::endl;
+    std::string path;
+    for(Task_Id id = last; id != -1; id = previous[id]) {
+      path = "  " + tasks[id].name + " (" + std::to_string(tasks[id].end - tasks[id].begin) + " ms)" + (path.empty() ? "" : "\n") + path;
+    }
+    if(!path.empty()) std::cout << path << std::endl;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+  static constexpr Task_Id Wake_Up = -1;
+
+  struct Task {
+    std::string name;
+    Affinity affinity{};
+    bool external{};
+    std::function<void()> work;
+    std::vector<Task_Id> dependencies;
+    std::vector<Task_Id> dependents;
+    // Milliseconds since run() started.
+    double begin{};
+    double end{};
+  };
+
+  std::vector<Task> tasks;
+  std::unique_ptr<std::atomic<int>[]> remaining_dependencies;
+  std::atomic<size_t> finished{0};
+  Completion_Queue<Task_Id> main_queue;
+  Thread_Pool* pool = nullptr;
+  Clock::time_point start{};
+  double wall_milliseconds{};
+
+  double milliseconds_since_start() const {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  void dispatch(Task_Id id) {
+    if(tasks[id].affinity == Affinity::Main) {
+      main_queue.push(id);
+    } else {
+      pool->submit([this, id] { execute(id); });
+    }
+  }
+
+  // True for the last task of the graph.
+  bool execute(Task_Id id) {
+    auto& task = tasks[id];
+    const Affinity affinity = task.affinity;
+    const size_t total = tasks.size();
+    task.begin = task.external ? 0.0 : milliseconds_since_start();
+    if(task.work) task.work();
+    task.end = milliseconds_since_start();
+
+    for(Task_Id dependent : task.dependents) {
+      if(--remaining_dependencies[dependent] == 0) dispatch(dependent);
+    }
+
+    // Once finished is incremented run() may return at any time, so a worker touches nothing but
+    // the queue afterwards, and only when it was last, which run() then waits for.
+    const bool last = ++finished == total;
+    if(last && affinity == Affinity::Worker) main_queue.push(Wake_Up);
+    return last;
+  }
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+// Fixed set of worker threads pulling jobs from one queue.
+class Thread_Pool {
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable job_available;
+  bool stopping = false;
+
+  void work() {
+    for(;;) {
+      std::function<void()> job;
+      {
+        std::unique_lock lock(mutex);
+        job_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if(jobs.empty()) return;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+public:
+  explicit Thread_Pool(unsigned int thread_count = std::max(1u, std::thread::hardware_concurrency())) {
+    workers.reserve(thread_count);
+    for(unsigned int i = 0; i < thread_count; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  Thread_Pool(const Thread_Pool&) = delete;
+  Thread_Pool& operator=(const Thread_Pool&) = delete;
+
+  // One pool for the whole process, sized to the machine.
+  static Thread_Pool& shared() {
+    static Thread_Pool pool;
+    return pool;
+  }
+
+  size_t thread_count() const {
+    return workers.size();
+  }
+
+  void submit(std::function<void()> job) {
+    {
+      std::lock_guard lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    job_available.notify_one();
+  }
+
+  ~Thread_Pool() {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    job_available.notify_all();
+    for(auto& worker : workers) worker.join();
+  }
+};
+
+// Results coming back from the workers, in the order they finish.
+template<typename T>
+class Completion_Queue {
+
+  std::deque<T> items;
+  std::mutex mutex;
+  std::condition_variable item_available;
+
+public:
+  // Notifies while holding the lock, so the consumer may destroy the queue as soon as it popped the item.
+  void push(T item) {
+    std::lock_guard lock(mutex);
+    items.push_back(std::move(item));
+    item_available.notify_one();
+  }
+
+  T pop() {
+    std::unique_lock lock(mutex);
+    item_available.wait(lock, [this] { return !items.empty(); });
+    T item = std::move(items.front());
+    items.pop_front();
+    return item;
+  }
+
+  std::optional<T> try_pop() {
+    std::lock_guard lock(mutex);
+    if(items.empty()) return std::nullopt;
+    T item = std::move(items.front());
+    items.pop_front();
+    return item;
+  }
+};
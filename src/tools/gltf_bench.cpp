@@ -0,0 +1,301 @@
+// Loader micro benchmarks.
+//
+//   gltf_bench [file.gltf | file.glb] [iterations]
+//
+// Without a file a synthetic multi-MB glTF is generated. No GL context is created, only the
+// CPU side of loading is measured. Base64 decoding of data URIs is measured separately on
+// 64 MiB of random bytes, EXT_meshopt_compression vertex decoding on 16 MiB of quantized vertices.
+
+#include "../renderer/gltf/parser.h"
+#include "../renderer/gltf/base64.h"
+#include "../renderer/gltf/meshopt_decode.h"
+
+#include <tiny_gltf.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <sstream>
+
+static std::atomic<size_t> allocation_count{0};
+
+void* operator new(size_t size) {
+  ++allocation_count;
+  if(void* pointer = std::malloc(size ? size : 1)) return pointer;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+
+template<typename F>
+void measure(const char* name, int iterations, size_t bytes, F&& run) {
+  using Clock = std::chrono::steady_clock;
+
+  // Warm up caches and the allocator.
+  if(!run()) {
+    std::cout << name << ": failed" << std::endl;
+    return;
+  }
+
+  size_t allocations_before = allocation_count;
+  auto start = Clock::now();
+  for(int i = 0; i < iterations; ++i) run();
+  auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+  size_t allocations = (allocation_count - allocations_before) / iterations;
+
+  std::cout << name << ": " << elapsed << " ms, "
+            << (double(bytes) / (1024.0 * 1024.0)) / (elapsed / 1000.0) << " MiB/s, "
+            << allocations << " allocations" << std::endl;
+}
+
+// Roughly what a CAD export looks like: lots of small nodes, meshes and accessors.
+static std::string make_synthetic_gltf(int mesh_count) {
+  std::ostringstream json;
+  json.precision(9);
+
+  json << "{\n  \"asset\": {\"version\": \"2.0\"},\n  \"scene\": 0,\n";
+  json << "  \"scenes\": [{\"name\": \"Scene\", \"nodes\": [";
+  for(int i = 0; i < mesh_count; ++i) json << (i ? ", " : "") << i;
+  json << "]}],\n";
+
+  json << "  \"nodes\": [\n";
+  for(int i = 0; i < mesh_count; ++i) {
+    json << "    {\"name\": \"node_" << i << "\", \"mesh\": " << i
+         << ", \"translation\": [" << i * 0.5 << ", " << i * 0.25 << ", " << -i * 0.125 << "]"
+         << ", \"rotation\": [0.0, 0.70710678, 0.0, 0.70710678]}" << (i + 1 < mesh_count ? ",\n" : "\n");
+  }
+  json << "  ],\n";
+
+  json << "  \"meshes\": [\n";
+  for(int i = 0; i < mesh_count; ++i) {
+    int a = i * 4;
+    json << "    {\"name\": \"mesh_" << i << "\", \"primitives\": [{\"attributes\": {\"POSITION\": " << a
+         << ", \"NORMAL\": " << a + 1 << ", \"TEXCOORD_0\": " << a + 2 << "}, \"indices\": " << a + 3
+         << ", \"material\": 0, \"mode\": 4}]}" << (i + 1 < mesh_count ? ",\n" : "\n");
+  }
+  json << "  ],\n";
+
+  // Every view aliases the same tiny buffer, so neither loader spends time on buffer bytes.
+  const char* types[] = {"VEC3", "VEC3", "VEC2", "SCALAR"};
+  const int component_types[] = {GL_FLOAT, GL_FLOAT, GL_FLOAT, GL_UNSIGNED_SHORT};
+  json << "  \"accessors\": [\n";
+  for(int i = 0; i < mesh_count * 4; ++i) {
+    json << "    {\"bufferView\": " << i << ", \"componentType\": " << component_types[i % 4] << ", \"count\": 3, \"type\": \"" << types[i % 4] << "\"";
+    if(i % 4 == 0) json << ", \"min\": [-1.0, -1.0, -1.0], \"max\": [1.0, 1.0, 1.0]";
+    json << "}" << (i + 1 < mesh_count * 4 ? ",\n" : "\n");
+  }
+  json << "  ],\n";
+
+  json << "  \"bufferViews\": [\n";
+  for(int i = 0; i < mesh_count * 4; ++i) {
+    json << "    {\"buffer\": 0, \"byteOffset\": 0, \"byteLength\": 36" << (i % 4 == 3 ? ", \"target\": 34963}" : ", \"target\": 34962}")
+         << (i + 1 < mesh_count * 4 ? ",\n" : "\n");
+  }
+  json << "  ],\n";
+
+  json << "  \"buffers\": [{\"byteLength\": 48, \"uri\": \"data:application/octet-stream;base64,"
+       << "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\"}],\n";
+  json << "  \"materials\": [{\"name\": \"default\", \"pbrMetallicRoughness\": {\"baseColorFactor\": [0.8, 0.8, 0.8, 1.0]}}]\n";
+  json << "}\n";
+  return json.str();
+}
+
+static std::string base64_encode(const std::vector<unsigned char>& bytes) {
+  constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string encoded;
+  encoded.reserve((bytes.size() + 2) / 3 * 4);
+  size_t i = 0;
+  for(; i + 3 <= bytes.size(); i += 3) {
+    uint32_t bits = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+    for(int shift = 18; shift >= 0; shift -= 6) encoded += alphabet[(bits >> shift) & 63];
+  }
+  if(i < bytes.size()) {
+    uint32_t bits = bytes[i] << 16;
+    if(i + 1 < bytes.size()) bits |= bytes[i + 1] << 8;
+    encoded += alphabet[(bits >> 18) & 63];
+    encoded += alphabet[(bits >> 12) & 63];
+    encoded += i + 1 < bytes.size() ? alphabet[(bits >> 6) & 63] : '=';
+    encoded += '=';
+  }
+  return encoded;
+}
+
+static void benchmark_base64(int iterations) {
+  std::vector<unsigned char> bytes(64 * 1024 * 1024 + 1);
+  std::mt19937 random(42);
+  for(auto& byte : bytes) byte = uint8_t(random());
+  const std::string encoded = base64_encode(bytes);
+  std::vector<unsigned char> decoded(gltf::base64_decoded_size(encoded));
+
+  const std::pair<const char*, gltf::Base64_Isa> decoders[] = {
+    {"base64 scalar", gltf::Base64_Isa::Scalar},
+    {"base64 sse4  ", gltf::Base64_Isa::Sse4},
+    {"base64 avx2  ", gltf::Base64_Isa::Avx2},
+  };
+  for(auto [name, isa] : decoders) {
+    if(isa > gltf::base64_best_isa()) continue;
+    std::fill(decoded.begin(), decoded.end(), 0);
+    // Throughput is per encoded byte, which is what a data URI costs to load.
+    measure(name, iterations, encoded.size(), [&] { return gltf::base64_decode(encoded, decoded.data(), isa); });
+    if(decoded != bytes) std::cout << name << ": decoded bytes differ" << std::endl;
+  }
+}
+
+// The meshopt vertex codec the other way around, picking the smallest encoding for every byte group.
+static void meshopt_encode_bytes(std::vector<unsigned char>& out, const unsigned char* bytes, size_t size) {
+  const size_t selectors = out.size();
+  out.resize(out.size() + (size / 16 + 3) / 4, 0);
+  for(size_t i = 0; i < size; i += 16) {
+    int best_log2 = 3;
+    size_t best_size = 16;
+    for(int bits_log2 : {0, 1, 2}) {
+      const int bits = bits_log2 == 0 ? 0 : 1 << bits_log2;
+      size_t encoded_size = size_t(bits * 2);
+      for(size_t k = 0; k < 16; ++k) {
+        if(bits == 0 ? bytes[i + k] != 0 : bytes[i + k] >= (1u << bits) - 1) encoded_size += bits == 0 ? 16 : 1;
+      }
+      if(encoded_size < best_size) {
+        best_size = encoded_size;
+        best_log2 = bits_log2;
+      }
+    }
+    out[selectors + i / 64] |= best_log2 << (i / 16 % 4 * 2);
+
+    if(best_log2 == 0) continue;
+    if(best_log2 == 3) {
+      out.insert(out.end(), bytes + i, bytes + i + 16);
+      continue;
+    }
+    const int bits = 1 << best_log2;
+    const unsigned sentinel = (1u << bits) - 1;
+    const size_t packed = out.size();
+    out.resize(out.size() + bits * 2, 0);
+    for(size_t k = 0; k < 16; ++k) {
+      const unsigned value = std::min<unsigned>(bytes[i + k], sentinel);
+      out[packed + k * bits / 8] |= value << (8 - bits - k * bits % 8);
+      if(value == sentinel) out.push_back(bytes[i + k]);
+    }
+  }
+}
+
+static std::vector<unsigned char> meshopt_encode_vertex_buffer(const std::vector<unsigned char>& vertices, size_t stride) {
+  const size_t count = vertices.size() / stride;
+  std::vector<unsigned char> out = {0xA0};
+  std::vector<unsigned char> last(vertices.begin(), vertices.begin() + stride);
+  const size_t block_size = gltf::meshopt_detail::vertex_block_size(stride);
+  std::vector<unsigned char> column;
+
+  for(size_t first = 0; first < count; first += block_size) {
+    const size_t block_count = std::min(block_size, count - first);
+    for(size_t k = 0; k < stride; ++k) {
+      column.assign((block_count + 15) & ~size_t(15), 0);
+      for(size_t i = 0; i < block_count; ++i) {
+        const unsigned char value = vertices[(first + i) * stride + k];
+        const int delta = int8_t(uint8_t(value - last[k]));
+        column[i] = uint8_t((delta << 1) ^ (delta >> 7));
+        last[k] = value;
+      }
+      meshopt_encode_bytes(out, column.data(), column.size());
+    }
+  }
+  // The first vertex, padded to the tail size.
+  out.resize(out.size() + (stride < 32 ? 32 - stride : 0), 0);
+  out.insert(out.end(), vertices.begin(), vertices.begin() + stride);
+  return out;
+}
+
+static void benchmark_meshopt(int iterations) {
+  // A 1024 x 1024 grid with 16 bit positions and 8 bit normals and texture coordinates.
+  constexpr size_t Stride = 16;
+  constexpr int Side = 1024;
+  std::vector<unsigned char> vertices(size_t(Side) * Side * Stride);
+  std::mt19937 random(42);
+  for(int y = 0; y < Side; ++y) {
+    for(int x = 0; x < Side; ++x) {
+      const uint16_t position[4] = {uint16_t(x * 64), uint16_t(random() % 512), uint16_t(y * 64), 0};
+      const int8_t normal[4] = {int8_t(random() % 16), 127, int8_t(random() % 16), 0};
+      const uint8_t texcoord[4] = {uint8_t(x), uint8_t(y), 0, 0};
+      unsigned char* vertex = vertices.data() + (size_t(y) * Side + x) * Stride;
+      std::memcpy(vertex, position, 8);
+      std::memcpy(vertex + 8, normal, 4);
+      std::memcpy(vertex + 12, texcoord, 4);
+    }
+  }
+  const auto encoded = meshopt_encode_vertex_buffer(vertices, Stride);
+  std::cout << "meshopt vertex codec: " << vertices.size() / 1024 << " KiB -> " << encoded.size() / 1024 << " KiB" << std::endl;
+  std::vector<unsigned char> decoded(vertices.size());
+
+  const std::pair<const char*, gltf::Meshopt_Isa> decoders[] = {
+    {"meshopt scalar", gltf::Meshopt_Isa::Scalar},
+    {"meshopt ssse3 ", gltf::Meshopt_Isa::Ssse3},
+  };
+  for(auto [name, isa] : decoders) {
+    if(isa > gltf::meshopt_best_isa()) continue;
+    std::fill(decoded.begin(), decoded.end(), 0);
+    // Throughput is per decoded byte, what ends up in the vertex buffers.
+    measure(name, iterations, decoded.size(), [&] { return gltf::meshopt_decode_vertex_buffer(decoded.data(), Side * Side, Stride, encoded, isa); });
+    if(decoded != vertices) std::cout << name << ": decoded bytes differ" << std::endl;
+  }
+}
+
+static bool skip_image_decode(tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*) {
+  return true;
+}
+
+int main(int argc, char** argv) {
+  std::string path = argc > 1 ? argv[1] : "";
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+
+  std::vector<unsigned char> file;
+  if(path.empty()) {
+    auto synthetic = make_synthetic_gltf(20000);
+    file.assign(synthetic.begin(), synthetic.end());
+    std::cout << "Synthetic glTF, " << file.size() / 1024 << " KiB of JSON" << std::endl;
+  } else {
+    std::ifstream stream(path, std::ios::binary);
+    if(!stream) {
+      std::cout << "Failed to open " << path << std::endl;
+      return 1;
+    }
+    file.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    std::cout << path << ", " << file.size() / 1024 << " KiB" << std::endl;
+  }
+
+  const auto base_dir = std::filesystem::path(path).parent_path().string();
+  const bool glb = file.size() >= 12 && std::memcmp(file.data(), "glTF", 4) == 0;
+
+  std::string_view json(reinterpret_cast<const char*>(file.data()), file.size());
+  if(glb) {
+    uint32_t json_length{};
+    std::memcpy(&json_length, file.data() + 12, 4);
+    json = json.substr(20, json_length);
+  }
+
+  measure("gltf::Parser", iterations, json.size(), [&] {
+    gltf::Asset asset;
+    std::string error;
+    return gltf::Parser::parse(json, asset, error);
+  });
+
+  // NOTE: tinygltf also resolves buffers while parsing, image decoding is turned off.
+  measure("tinygltf    ", iterations, json.size(), [&] {
+    tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(skip_image_decode, nullptr);
+    tinygltf::Model model;
+    std::string err, warn;
+    if(glb) return loader.LoadBinaryFromMemory(&model, &err, &warn, file.data(), (unsigned int) file.size(), base_dir);
+    return loader.LoadASCIIFromString(&model, &err, &warn, json.data(), (unsigned int) json.size(), base_dir);
+  });
+
+  benchmark_base64(iterations);
+  benchmark_meshopt(iterations);
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+// Turns a .gltf or .glb into a cooked blob for gltf::Data::load_cooked().
+//
+//   gltf_cook [--repack] [--quantize] [--optimize] [--encode-textures] input.gltf output.cooked
+//
+// Runs the CPU side of the loader once, offline: parsing, buffer reads, image decoding, vertex
+// layouts and animation extraction. No GL context is needed. --repack stores interleaved vertex
+// streams with only the attributes basic.vs reads, --quantize also shrinks them and --optimize
+// reorders them and their indices for the GPU caches, see Loader::Repack_Options.
+// --encode-textures stores PNG and JPEG images as BCn with their mip chains, see
+// Loader::Texture_Encode_Options.
+
+#include "../renderer/gltf/cooked.h"
+
+#include <chrono>
+#include <fstream>
+
+int main(int argc, char** argv) {
+  gltf::Loader loader;
+  int argument = 1;
+  for(; argument < argc && std::string_view(argv[argument]).starts_with("--"); ++argument) {
+    const std::string_view option = argv[argument];
+    if(option == "--repack") {
+      loader.repack.enabled = true;
+    } else if(option == "--quantize") {
+      loader.repack.enabled = true;
+      loader.repack.quantize = true;
+    } else if(option == "--optimize") {
+      loader.repack.enabled = true;
+      loader.repack.optimize = true;
+    } else if(option == "--encode-textures") {
+      loader.texture_encode.enabled = true;
+    } else {
+      break;
+    }
+  }
+  if(argc - argument != 2) {
+    std::cout << "usage: gltf_cook [--repack] [--quantize] [--optimize] [--encode-textures] input.gltf output.cooked" << std::endl;
+    return 1;
+  }
+  const char* input = argv[argument];
+  const char* output_path = argv[argument + 1];
+
+  // Has to match what the engine does before loading, the pixels are stored as decoded.
+  stbi_set_flip_vertically_on_load(true);
+
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+
+  if(!loader.load_sources(input)) {
+    std::cout << "Failed to load " << input << std::endl;
+    return 1;
+  }
+  auto loaded = Clock::now();
+
+  std::vector<unsigned char> blob;
+  if(!gltf::cooked::Writer::cook(loader, blob)) {
+    std::cout << "Failed to cook " << input << std::endl;
+    return 1;
+  }
+
+  std::ofstream output(output_path, std::ios::binary | std::ios::trunc);
+  output.write(reinterpret_cast<const char*>(blob.data()), std::streamsize(blob.size()));
+  if(!output) {
+    std::cout << "Failed to write " << output_path << std::endl;
+    return 1;
+  }
+
+  std::cout << output_path << ": " << blob.size() / 1024 << " KiB, " << loader.meshes.size() << " meshes, "
+            << loader.images.size() << " images, " << loader.animations.size() << " animations. Loaded in "
+            << std::chrono::duration<double, std::milli>(loaded - start).count() << " ms, cooked in "
+            << std::chrono::duration<double, std::milli>(Clock::now() - loaded).count() << " ms" << std::endl;
+  return 0;
+}
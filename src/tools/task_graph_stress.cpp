@@ -0,0 +1,38 @@
+// Runs many short-lived Task_Graphs made of worker tasks only, each destroyed right after run()
+// returns, the way Loader::run_load_graph uses them. A worker still touching a graph after run()
+// returned shows up as a crash or a sanitizer report.
+//
+//   task_graph_stress [iterations]
+
+#include "../task_graph.h"
+
+#include <cstdlib>
+
+int main(int argc, char** argv) {
+  const int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+  Thread_Pool pool;
+
+  for(int iteration = 0; iteration < iterations; ++iteration) {
+    std::atomic<int> ran{0};
+    // Independent tasks, then a fan-in and a short chain, so the last task to finish varies.
+    const int width = 1 + iteration % int(pool.thread_count() * 2);
+    {
+      Task_Graph graph;
+      std::vector<Task_Graph::Task_Id> leaves;
+      for(int i = 0; i < width; ++i) {
+        leaves.push_back(graph.add("leaf", Task_Graph::Affinity::Worker, [&ran] { ++ran; }));
+      }
+      if(iteration % 2 == 0) {
+        Task_Graph::Task_Id join = graph.add("join", Task_Graph::Affinity::Worker, [&ran] { ++ran; }, leaves);
+        graph.add("tail", Task_Graph::Affinity::Worker, [&ran] { ++ran; }, {join});
+      }
+      graph.run(pool);
+      if(ran != int(graph.size())) {
+        std::cout << "iteration " << iteration << ": " << ran << " of " << graph.size() << " tasks ran" << std::endl;
+        return 1;
+      }
+    }
+  }
+  std::cout << iterations << " graphs ran" << std::endl;
+  return 0;
+}